@@ -1,13 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "intel8086.h"
+#include <unistd.h>
+#include "5150emu.h"
+#include "snapshot.h"
+#include "kbd.h"
+#include "floppy.h"
+#include "hdimage.h"
+#include "bios.h"
+#include "dos.h"
+#include "batch.h"
 #define BIOS_FILE "0239462.BIN"
+//checkpoint ring for stepping backwards, ~1MB each
+#define HISTORY_SLOTS 16
+#define HISTORY_INTERVAL 100000
 
 
-void load_bios(X86Cpu *cpu, char *filename);
-
-int main_loop(X86Cpu *cpu, int instructions);
+int main_loop(X86Cpu *cpu, int instructions, History *hist);
 
 //array for RAM according to emu8086 0x10FFEF bytes
 //unsigned char ram[0x100000];
@@ -21,62 +30,300 @@ void ram_dump(X86Cpu *cpu)
 	fclose(ramdmp);
 }
 
-int main(int argc, char **argv)
+//the text screen as the guest left it, "-" for stdout
+int screen_dump(X86Cpu *cpu, char *filename)
 {
-	X86Cpu *cpu;
-	cpu = malloc(sizeof(X86Cpu)); 
-	init_8086(cpu);
-	load_bios(cpu, BIOS_FILE);
+	char buf[(VIDEO_MAX_W / 8 + 1) * (VIDEO_MAX_H / 8) + 1];
+	FILE *fp;
 
-	main_loop(cpu, 10);
+	if (video_text(cpu, buf, sizeof(buf), NULL) < 0)
+		return -1;
+	fp = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+	if (fp == NULL)
+		return -1;
+	fputs(buf, fp);
+	if (fp != stdout)
+		fclose(fp);
+	return 0;
+}
 
-	ram_dump(cpu);
-	free(cpu->ram);
-	free(cpu);
+int batch_main(char *joblist, int threads, int instructions, uint64_t slice)
+{
+	BatchJob *jobs;
+	int njobs, status;
 
-	return 0;
+	njobs = batch_read_list(joblist, &jobs);
+	if (njobs < 0)
+	{
+		fprintf(stderr, "can't read job list %s\n", joblist);
+		return 1;
+	}
+
+	status = batch_run(jobs, njobs, threads, instructions, slice);
+	batch_report(stdout, jobs, njobs);
+	batch_free(jobs, njobs);
+
+	return status == 0 ? 0 : 1;
+}
+
+void usage(char *name)
+{
+	fprintf(stderr, "usage: %s [-n instructions] [-r back] [-i interval] [-q]\n"
+		"\t[-l snapshot] [-s snapshot] [-k keyscript] [-f charrom]\n"
+		"\t[-T screenfile] [-P screenshot [-F frames]] [-R]\n"
+		"\t[-a diskimage] [-b diskimage] [-c hdimage [-o overlay]]\n"
+		"\t[-I] [-H] [-W] [-D dosdir] [-x program [args ...]]\n"
+		"\t[-B joblist [-j threads] [-t slice]]\n",
+		name);
+	exit(1);
 }
 
-void load_bios(X86Cpu *cpu, char *filename)
+int main(int argc, char **argv)
 {
-	FILE *bios;
-	#define BIOS_SIZE 0x10000
-	#define BIOS_ADDR 0xF0000
-	uint8_t *tmp = malloc(BIOS_SIZE);
-	uint8_t *ram=cpu->ram;
-	bios = fopen(filename,"rb");
-
-	if (bios == NULL)
+	X86Cpu *cpu;
+	History hist;
+	int instructions = 10;
+	int limited = 0;
+	uint64_t back = 0;
+	uint64_t interval = HISTORY_INTERVAL;
+	int trace = 1;
+	char *image = BIOS_FILE;
+	char *save = NULL;
+	char *joblist = NULL;
+	char *keys = NULL;
+	char *font = NULL;
+	char *screen = NULL;
+	char *shot = NULL;
+	char *disk[2] = { NULL, NULL };
+	char *hdisk = NULL;
+	char *overlay = NULL;
+	int instant = 0;
+	int hle = 0;
+	int warm = 0;
+	char *program = NULL;
+	char *dosdir = NULL;
+	char tail[128] = "";
+	uint32_t every = 0;
+	int render_thread = 0;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t slice = BATCH_SLICE;
+	int opt, status;
+
+	while ((opt = getopt(argc, argv, "n:r:i:ql:s:B:j:t:k:f:T:P:F:Ra:b:c:o:IHWx:D:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				instructions = atoi(optarg);
+				limited = 1;
+				break;
+			case 'r':
+				back = strtoull(optarg, NULL, 0);
+				break;
+			case 'i':
+				interval = strtoull(optarg, NULL, 0);
+				break;
+			case 'q':
+				trace = 0;
+				break;
+			case 'l':
+				image = optarg;
+				break;
+			case 's':
+				save = optarg;
+				break;
+			case 'B':
+				joblist = optarg;
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 't':
+				slice = strtoull(optarg, NULL, 0);
+				break;
+			case 'k':
+				keys = optarg;
+				break;
+			case 'f':
+				font = optarg;
+				break;
+			case 'T':
+				screen = optarg;
+				break;
+			case 'P':
+				shot = optarg;
+				break;
+			case 'F':
+				every = strtoul(optarg, NULL, 0);
+				break;
+			case 'R':
+				render_thread = 1;
+				break;
+			case 'a':
+				disk[0] = optarg;
+				break;
+			case 'b':
+				disk[1] = optarg;
+				break;
+			case 'c':
+				hdisk = optarg;
+				break;
+			case 'o':
+				overlay = optarg;
+				break;
+			case 'I':
+				instant = 1;
+				break;
+			case 'H':
+				hle = 1;
+				break;
+			case 'W':
+				warm = 1;
+				break;
+			case 'x':
+				program = optarg;
+				break;
+			case 'D':
+				dosdir = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (interval == 0 || slice == 0 || (optind < argc && !program))
+		usage(argv[0]);
+	//whatever follows the options is the program's command tail
+	for (; optind < argc; optind++)
+	{
+		if (tail[0])
+			strncat(tail, " ", sizeof(tail) - strlen(tail) - 1);
+		strncat(tail, argv[optind], sizeof(tail) - strlen(tail) - 1);
+	}
+
+	if (joblist)
+		return batch_main(joblist, threads, instructions, slice);
+	//a DOS program runs until it exits unless told otherwise, -1 for no limit
+	if (program && !limited)
+		instructions = -1;
+
+	cpu = machine_create();
+	if (cpu == NULL)
 	{
-		printf("BIOS %s not found!",filename);
-		fclose(bios);
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	cpu->trace = trace;
+	if (load_image(cpu, image) != 0)
+		exit(1);
+	if (warm)
+		fast_boot(cpu);
+	if (dosdir && dos_set_root(cpu, dosdir) != 0)
+		exit(1);
+	if (program && dos_load(cpu, program, tail) != 0)
 		exit(1);
+	if (keys && kbd_load_script(cpu, keys) != 0)
+		exit(1);
+	if (font && video_load_font(cpu, font) != 0)
+		exit(1);
+	if ((disk[0] && floppy_insert(cpu, 0, disk[0]) != 0)
+		|| (disk[1] && floppy_insert(cpu, 1, disk[1]) != 0))
+		exit(1);
+	if (hdisk && hd_attach(cpu, 0, hdisk, overlay) != 0)
+		exit(1);
+	cpu->floppy->instant = instant;
+	cpu->hdisk->instant = instant;
+	//with no BIOS booted a program's INT 10h has to reach something
+	bios_hle_enable(cpu, hle || program);
+	if (shot && every && video_capture(cpu, shot, every) != 0)
+		exit(1);
+	if (render_thread && video_start_thread(cpu) != 0)
+		fprintf(stderr, "no render thread, drawing on the cpu thread\n");
+
+	//stepping back would replay a program's console and file writes
+	if (back && program)
+	{
+		fprintf(stderr, "no stepping back with -x, ignoring -r\n");
+		back = 0;
+	}
+	//and disk writes onto overlays that already hold them
+	if (back && (disk[0] || disk[1] || hdisk))
+	{
+		fprintf(stderr, "no stepping back with a disk attached, ignoring -r\n");
+		back = 0;
+	}
+	//the key script has moved past keys the replay would want again
+	if (back && keys)
+	{
+		fprintf(stderr, "no stepping back with -k, ignoring -r\n");
+		back = 0;
+	}
+	if (back && history_init(&hist, HISTORY_SLOTS, interval) != 0)
+	{
+		fprintf(stderr, "no memory for %d checkpoints\n", HISTORY_SLOTS);
+		back = 0;
+	}
+
+	main_loop(cpu, instructions, back ? &hist : NULL);
+
+	if (back)
+	{
+		if (history_step_back(&hist, cpu, back) != 0)
+			fprintf(stderr, "can't step back %llu, no checkpoint that old\n",
+				(unsigned long long)back);
+		printf("\nstepped back to instruction %llu\n",
+			(unsigned long long)cpu->insns);
+		print_flags(cpu);
+		printf(" ");
+		print_registers(cpu);
+		history_free(&hist);
 	}
 
-	fread(tmp, 1, BIOS_SIZE, bios);
-	memcpy(&cpu->ram[BIOS_ADDR], tmp, BIOS_SIZE);
-	printf("%x\n", tmp[0]);
-	free(tmp);
+	if (save && snapshot_save(cpu, save) != 0)
+		fprintf(stderr, "couldn't write snapshot %s\n", save);
+
+	//the final screen is drawn from RAM as it is now
+	video_stop_thread(cpu);
+	if (screen && screen_dump(cpu, screen) != 0)
+		fprintf(stderr, "couldn't write screen to %s\n", screen);
+	if (shot && !every && video_screenshot(cpu, shot) != 0)
+		fprintf(stderr, "couldn't write screenshot %s\n", shot);
 
+	ram_dump(cpu);
+	//a program that ran to completion passes its exit code on
+	status = program ? dos_exit_code(cpu) : 0;
+	machine_destroy(cpu);
+	if (status < 0)
+	{
+		fprintf(stderr, "%s stopped before it exited\n", program);
+		return 1;
+	}
+
+	return status;
 }
 
-int main_loop(X86Cpu *cpu, int instructions)
+int main_loop(X86Cpu *cpu, int instructions, History *hist)
 {
 	uint32_t PC = 0;
 	//PC = 0xFFFF0;
 	cpu->running = 1;
 	fprintf(stderr,"starting at %x\n",cpu->ip | cpu->cs << 4);
-	while((cpu->running == 1) && (instructions > 0))
+	while((cpu->running == 1) && (instructions != 0))
 	{
 	//need to fix so it uses IP + CS
 //	DoOP(ram[PC]);
 		PC = 0;//?
+		if (hist)
+			history_step(hist, cpu);
 		do_op(cpu);
-		printf("\n");	
-		print_flags(cpu);
-		printf(" ");
-		print_registers(cpu);
-		instructions--;
+		if (cpu->trace)
+		{
+			printf("\n");	
+			print_flags(cpu);
+			printf(" ");
+			print_registers(cpu);
+		}
+		if (instructions > 0)
+			instructions--;
 		if(cpu->running == 0)
 		break;
 	}
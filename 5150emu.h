@@ -1 +1,16 @@
-extern unsigned char ram[0x10FFEF];
+#ifndef EMU5150_H
+#define EMU5150_H
+#include "intel8086.h"
+
+#define BIOS_SIZE 0x10000
+#define BIOS_ADDR 0xF0000
+
+X86Cpu *machine_create(void);
+void machine_destroy(X86Cpu *cpu);
+int load_bios(X86Cpu *cpu, char *filename);
+int fast_boot(X86Cpu *cpu);
+int load_image(X86Cpu *cpu, char *filename);
+void ram_dump(X86Cpu *cpu);
+int screen_dump(X86Cpu *cpu, char *filename);
+
+#endif
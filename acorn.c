@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "acorn.h"
+#include "5150emu.h"
+#include "snapshot.h"
+#include "mem.h"
+#include "kbd.h"
+#include "floppy.h"
+#include "hdimage.h"
+#include "bios.h"
+#include "dos.h"
+
+AcornEmu *acorn_create(void)
+{
+	return machine_create();
+}
+
+void acorn_destroy(AcornEmu *emu)
+{
+	machine_destroy(emu);
+}
+
+int acorn_load_bios(AcornEmu *emu, const char *filename)
+{
+	return load_bios(emu, (char *)filename);
+}
+
+int acorn_fast_boot(AcornEmu *emu)
+{
+	return fast_boot(emu);
+}
+
+int acorn_load_snapshot(AcornEmu *emu, const char *filename)
+{
+	return snapshot_load(emu, (char *)filename);
+}
+
+int acorn_save_snapshot(AcornEmu *emu, const char *filename)
+{
+	return snapshot_save(emu, (char *)filename);
+}
+
+//returns the cycles actually run, less than asked if the cpu halted
+uint64_t acorn_run(AcornEmu *emu, uint64_t cycles)
+{
+	return run_8086_slice(emu, cycles, UINT64_MAX);
+}
+
+//0 if the instruction ran, -1 if the cpu halted on it
+int acorn_step(AcornEmu *emu)
+{
+	run_8086(emu, 1);
+	return emu->running ? 0 : -1;
+}
+
+//addresses are physical, accesses past the top of memory fail
+int acorn_read_mem(AcornEmu *emu, uint32_t addr, void *buf, size_t len)
+{
+	if (addr > RAM_SIZE || len > RAM_SIZE - addr)
+		return -1;
+	memcpy(buf, &emu->ram[addr], len);
+	return 0;
+}
+
+int acorn_write_mem(AcornEmu *emu, uint32_t addr, const void *buf, size_t len)
+{
+	if (addr > RAM_SIZE || len > RAM_SIZE - addr)
+		return -1;
+	memcpy(&emu->ram[addr], buf, len);
+	mem_dirty(emu, addr, len);
+	return 0;
+}
+
+void acorn_get_regs(AcornEmu *emu, AcornRegs *regs)
+{
+	regs->ax = emu->ax.w;
+	regs->bx = emu->bx.w;
+	regs->cx = emu->cx.w;
+	regs->dx = emu->dx.w;
+	regs->sp = emu->sp;
+	regs->bp = emu->bp;
+	regs->si = emu->si;
+	regs->di = emu->di;
+	regs->ip = emu->ip;
+	regs->flags = emu->flags;
+	regs->cs = emu->cs;
+	regs->ds = emu->ds;
+	regs->ss = emu->ss;
+	regs->es = emu->es;
+	regs->cycles = emu->cycles;
+	regs->insns = emu->insns;
+	regs->running = emu->running;
+}
+
+//cycle and instruction counts are left alone
+void acorn_set_regs(AcornEmu *emu, const AcornRegs *regs)
+{
+	emu->ax.w = regs->ax;
+	emu->bx.w = regs->bx;
+	emu->cx.w = regs->cx;
+	emu->dx.w = regs->dx;
+	emu->sp = regs->sp;
+	emu->bp = regs->bp;
+	emu->si = regs->si;
+	emu->di = regs->di;
+	emu->ip = regs->ip;
+	emu->flags = regs->flags;
+	intr_sync_8086(emu);
+	emu->cs = regs->cs;
+	emu->ds = regs->ds;
+	emu->ss = regs->ss;
+	emu->es = regs->es;
+}
+
+int acorn_key(AcornEmu *emu, uint8_t scancode)
+{
+	return kbd_push(emu, scancode);
+}
+
+int acorn_load_keys(AcornEmu *emu, const char *filename)
+{
+	return kbd_load_script(emu, filename);
+}
+
+int acorn_load_font(AcornEmu *emu, const char *filename)
+{
+	return video_load_font(emu, filename);
+}
+
+const uint32_t *acorn_framebuffer(AcornEmu *emu, int *width, int *height)
+{
+	return video_pixels(emu, width, height);
+}
+
+int acorn_read_framebuffer(AcornEmu *emu, uint32_t *buf, size_t size,
+	int *width, int *height)
+{
+	return video_copy_pixels(emu, buf, size, width, height);
+}
+
+int acorn_render_thread(AcornEmu *emu, int on)
+{
+	if (!on)
+	{
+		video_stop_thread(emu);
+		return 0;
+	}
+	return video_start_thread(emu);
+}
+
+int acorn_screen_text(AcornEmu *emu, char *buf, size_t size, uint64_t *changed)
+{
+	return video_text(emu, buf, size, changed);
+}
+
+int acorn_screenshot(AcornEmu *emu, const char *filename)
+{
+	return video_screenshot(emu, filename);
+}
+
+int acorn_capture(AcornEmu *emu, const char *filename, uint32_t every)
+{
+	return video_capture(emu, filename, every);
+}
+
+int acorn_insert_disk(AcornEmu *emu, int drive, const char *filename)
+{
+	return floppy_insert(emu, drive, filename);
+}
+
+void acorn_eject_disk(AcornEmu *emu, int drive)
+{
+	floppy_eject(emu, drive);
+}
+
+void acorn_instant_seek(AcornEmu *emu, int on)
+{
+	emu->floppy->instant = on;
+	emu->hdisk->instant = on;
+}
+
+int acorn_attach_disk(AcornEmu *emu, int drive, const char *base,
+	const char *overlay)
+{
+	return hd_attach(emu, drive, base, overlay);
+}
+
+void acorn_detach_disk(AcornEmu *emu, int drive)
+{
+	hd_detach(emu, drive);
+}
+
+int acorn_make_disk(const char *filename, const char *raw, int type)
+{
+	return hd_make(filename, raw, type);
+}
+
+void acorn_bios_hle(AcornEmu *emu, int on)
+{
+	bios_hle_enable(emu, on);
+}
+
+int acorn_load_program(AcornEmu *emu, const char *filename, const char *args)
+{
+	return dos_load(emu, filename, args);
+}
+
+int acorn_exit_code(AcornEmu *emu)
+{
+	return dos_exit_code(emu);
+}
+
+int acorn_dos_root(AcornEmu *emu, const char *dir)
+{
+	return dos_set_root(emu, dir);
+}
@@ -0,0 +1,112 @@
+#ifndef ACORN_H
+#define ACORN_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* libacorn: the emulator as a library.  Every AcornEmu is independent and
+ * the library keeps no global state, so different emulators can be driven
+ * from different threads at once.  A single AcornEmu is not locked, only one
+ * thread may use it at a time. */
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct X86Cpu AcornEmu;
+
+typedef struct {
+	uint16_t ax, bx, cx, dx;
+	uint16_t sp, bp, si, di;
+	uint16_t ip, flags;
+	uint16_t cs, ds, ss, es;
+	uint64_t cycles;
+	uint64_t insns;
+	int running;
+} AcornRegs;
+
+AcornEmu *acorn_create(void);
+void acorn_destroy(AcornEmu *emu);
+int acorn_load_bios(AcornEmu *emu, const char *filename);
+/* Patch the loaded BIOS so a cold start skips POST's memory tests the way
+ * a warm boot does.  Fails, leaving the ROM alone, for an unknown BIOS. */
+int acorn_fast_boot(AcornEmu *emu);
+int acorn_load_snapshot(AcornEmu *emu, const char *filename);
+int acorn_save_snapshot(AcornEmu *emu, const char *filename);
+uint64_t acorn_run(AcornEmu *emu, uint64_t cycles);
+int acorn_step(AcornEmu *emu);
+int acorn_read_mem(AcornEmu *emu, uint32_t addr, void *buf, size_t len);
+int acorn_write_mem(AcornEmu *emu, uint32_t addr, const void *buf, size_t len);
+void acorn_get_regs(AcornEmu *emu, AcornRegs *regs);
+void acorn_set_regs(AcornEmu *emu, const AcornRegs *regs);
+
+/* Keyboard input as 5150 scan codes.  Unlike the rest of the API acorn_key
+ * may be called from one other thread while the emulator is running, it
+ * fails rather than blocks if the guest has fallen behind. */
+int acorn_key(AcornEmu *emu, uint8_t scancode);
+int acorn_load_keys(AcornEmu *emu, const char *filename);
+
+/* The screen as 0xRRGGBB pixels, redrawn once per emulated frame.  The
+ * pointer stays valid for the life of the AcornEmu.  acorn_render_thread
+ * moves drawing to a thread of its own so acorn_run never pays for it;
+ * while it runs read the screen with acorn_read_framebuffer, which copies
+ * a whole frame out (size is in pixels). */
+int acorn_load_font(AcornEmu *emu, const char *filename);
+const uint32_t *acorn_framebuffer(AcornEmu *emu, int *width, int *height);
+int acorn_read_framebuffer(AcornEmu *emu, uint32_t *buf, size_t size,
+	int *width, int *height);
+int acorn_render_thread(AcornEmu *emu, int on);
+
+/* The text screen as one NUL terminated string, a line per row.  changed
+ * gets a bit per row that differs from the previous call.  Returns the
+ * number of rows, 0 in a graphics mode or -1 if size is too small; 80x25
+ * needs 2026 bytes. */
+int acorn_screen_text(AcornEmu *emu, char *buf, size_t size, uint64_t *changed);
+
+/* Screenshots as PPM, or PNG for names ending .png.  acorn_capture saves
+ * one every so many emulated frames (0 stops), numbering the files. */
+int acorn_screenshot(AcornEmu *emu, const char *filename);
+int acorn_capture(AcornEmu *emu, const char *filename, uint32_t every);
+
+/* Floppy images of 160K, 180K, 320K or 360K in drives 0-3.  The file is
+ * only ever read, what the guest writes stays in memory until the disk is
+ * ejected.  Instant seek makes every disk command finish at once. */
+int acorn_insert_disk(AcornEmu *emu, int drive, const char *filename);
+void acorn_eject_disk(AcornEmu *emu, int drive);
+void acorn_instant_seek(AcornEmu *emu, int on);
+
+/* Fixed disks 0-1 on a shared read only base image, sparse or raw.  Writes
+ * go to the overlay file, created if missing, or to memory if overlay is
+ * NULL.  acorn_make_disk writes a sparse base from a raw image, or a blank
+ * one of XT drive type 0-3 if raw is NULL. */
+int acorn_attach_disk(AcornEmu *emu, int drive, const char *base,
+	const char *overlay);
+void acorn_detach_disk(AcornEmu *emu, int drive);
+int acorn_make_disk(const char *filename, const char *raw, int type);
+
+/* Service IRQ 1 and INT 10h, 13h, 16h and 1Ah in C rather than running the ROM's
+ * code for them, as long as the guest has not hooked the vector. */
+void acorn_bios_hle(AcornEmu *emu, int on);
+
+/* Run a .COM or .EXE without booting: the program is loaded with a PSP and
+ * args as its command tail, and INT 20h and 21h are serviced in C.  When it
+ * terminates the cpu halts and acorn_exit_code gives its return code, -1
+ * until then.  The console is stdin and stdout.  Files are only reachable
+ * below the directory given to acorn_dos_root, none by default.  If the
+ * BIOS never ran, the data area, video mode, PIC and keyboard are set up
+ * as POST would, but INT 9h, 10h and 16h only do anything with
+ * acorn_bios_hle on.  Snapshots fail while the program has files open. */
+int acorn_load_program(AcornEmu *emu, const char *filename, const char *args);
+int acorn_exit_code(AcornEmu *emu);
+int acorn_dos_root(AcornEmu *emu, const char *dir);
+
+#endif
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "5150emu.h"
+#include "batch.h"
+
+/* Work stealing: every worker owns a deque of job indices.  The owner takes
+ * from the bottom and puts unfinished jobs back on the top, so its own jobs
+ * round robin; idle workers steal from the top of someone else's, which is
+ * where the long running jobs collect.  Slices
+ * are long enough that a mutex per deque never shows up in profiles.  A
+ * worker that finds nothing to take sleeps until a job is put back or the
+ * last one finishes. */
+typedef struct {
+	pthread_mutex_t lock;
+	int *slots;		//ring of job indices, sized for every job
+	int size;
+	int top, bottom;	//bottom - top is the number queued
+} BatchDeque;
+
+typedef struct {
+	BatchJob *jobs;
+	int njobs;
+	pthread_mutex_t lock;	//guards left and queued
+	pthread_cond_t wake;
+	int left;		//jobs not finished yet
+	int queued;		//jobs sitting in a deque
+	uint64_t instructions;
+	uint64_t slice;
+	BatchDeque *deques;
+	int nworkers;
+} BatchQueue;
+
+typedef struct {
+	BatchQueue *queue;
+	int id;
+} BatchWorker;
+
+static int deque_init(BatchDeque *dq, int size)
+{
+	dq->slots = malloc(size * sizeof(int));
+	if (dq->slots == NULL)
+		return -1;
+	dq->size = size;
+	dq->top = dq->bottom = 0;
+	pthread_mutex_init(&dq->lock, NULL);
+	return 0;
+}
+
+static void deque_free(BatchDeque *dq)
+{
+	pthread_mutex_destroy(&dq->lock);
+	free(dq->slots);
+}
+
+static void deque_push_top(BatchDeque *dq, int job)
+{
+	pthread_mutex_lock(&dq->lock);
+	dq->top--;
+	dq->slots[(dq->top % dq->size + dq->size) % dq->size] = job;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+static void deque_push_bottom(BatchDeque *dq, int job)
+{
+	pthread_mutex_lock(&dq->lock);
+	dq->slots[(dq->bottom % dq->size + dq->size) % dq->size] = job;
+	dq->bottom++;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+//-1 if empty
+static int deque_pop(BatchDeque *dq)
+{
+	int job = -1;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom != dq->top)
+	{
+		dq->bottom--;
+		job = dq->slots[(dq->bottom % dq->size + dq->size) % dq->size];
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return job;
+}
+
+static int deque_steal(BatchDeque *dq)
+{
+	int job = -1;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom != dq->top)
+	{
+		job = dq->slots[(dq->top % dq->size + dq->size) % dq->size];
+		dq->top++;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return job;
+}
+
+//one line per image, blank lines and lines starting with # are skipped
+int batch_read_list(char *filename, BatchJob **jobs)
+{
+	FILE *fp;
+	char line[1024];
+	BatchJob *list = NULL, *tmp;
+	int n = 0, size = 0;
+	char *p;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		if (n == size)
+		{
+			size = size ? size * 2 : 16;
+			tmp = realloc(list, size * sizeof(BatchJob));
+			if (tmp == NULL)
+			{
+				batch_free(list, n);
+				fclose(fp);
+				return -1;
+			}
+			list = tmp;
+		}
+		memset(&list[n], 0, sizeof(BatchJob));
+		list[n].path = strdup(p);
+		n++;
+	}
+	fclose(fp);
+
+	*jobs = list;
+	return n;
+}
+
+void batch_free(BatchJob *jobs, int njobs)
+{
+	int i;
+
+	for (i = 0; i < njobs; i++)
+		free(jobs[i].path);
+	free(jobs);
+}
+
+static int start_job(BatchJob *job, uint64_t instructions)
+{
+	X86Cpu *cpu;
+
+	cpu = machine_create();
+	if (cpu == NULL)
+		return -1;
+
+	if (load_image(cpu, job->path) != 0)
+	{
+		machine_destroy(cpu);
+		return -1;
+	}
+	job->cpu = cpu;
+	job->limit = cpu->insns + instructions;
+	return 0;
+}
+
+static void finish_job(BatchJob *job)
+{
+	if (job->cpu)
+	{
+		job->final = *job->cpu;
+		job->final.ram = NULL;
+		machine_destroy(job->cpu);
+		job->cpu = NULL;
+	}
+}
+
+//returns 1 when the job is finished
+static int run_job(BatchJob *job, uint64_t instructions, uint64_t slice)
+{
+	if (job->cpu == NULL)
+	{
+		job->status = start_job(job, instructions);
+		if (job->status != 0)
+			return 1;
+	}
+
+	run_8086_slice(job->cpu, slice, job->limit);
+	job->slices++;
+
+	if (!job->cpu->running || job->cpu->insns >= job->limit)
+	{
+		finish_job(job);
+		return 1;
+	}
+	return 0;
+}
+
+static int find_job(BatchQueue *queue, int id)
+{
+	int i, job;
+
+	job = deque_pop(&queue->deques[id]);
+	for (i = 1; job < 0 && i < queue->nworkers; i++)
+		job = deque_steal(&queue->deques[(id + i) % queue->nworkers]);
+
+	return job;
+}
+
+static void *batch_worker(void *arg)
+{
+	BatchWorker *worker = arg;
+	BatchQueue *queue = worker->queue;
+	int job, done;
+
+	for (;;)
+	{
+		job = find_job(queue, worker->id);
+		if (job < 0)
+		{
+			//everything left is being run by someone else
+			pthread_mutex_lock(&queue->lock);
+			while (queue->queued == 0 && queue->left > 0)
+				pthread_cond_wait(&queue->wake, &queue->lock);
+			done = queue->left == 0;
+			pthread_mutex_unlock(&queue->lock);
+			if (done)
+				break;
+			continue;
+		}
+		pthread_mutex_lock(&queue->lock);
+		queue->queued--;
+		pthread_mutex_unlock(&queue->lock);
+
+		if (run_job(&queue->jobs[job], queue->instructions, queue->slice))
+		{
+			pthread_mutex_lock(&queue->lock);
+			if (--queue->left == 0)
+				pthread_cond_broadcast(&queue->wake);
+			pthread_mutex_unlock(&queue->lock);
+		}
+		else
+		{
+			deque_push_top(&queue->deques[worker->id], job);
+			pthread_mutex_lock(&queue->lock);
+			queue->queued++;
+			pthread_cond_signal(&queue->wake);
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns -1 if the queue could not be set up, with every job marked as
+ * never run rather than left looking like a clean result. */
+int batch_run(BatchJob *jobs, int njobs, int nthreads, uint64_t instructions,
+	uint64_t slice)
+{
+	BatchQueue queue;
+	BatchWorker *workers;
+	pthread_t *threads;
+	int i, started, ret = -1;
+
+	if (nthreads > njobs)
+		nthreads = njobs;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	queue.jobs = jobs;
+	queue.njobs = njobs;
+	queue.left = njobs;
+	queue.queued = njobs;
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_cond_init(&queue.wake, NULL);
+	queue.instructions = instructions;
+	queue.slice = slice;
+	queue.nworkers = 0;
+	queue.deques = calloc(nthreads, sizeof(BatchDeque));
+	workers = calloc(nthreads, sizeof(BatchWorker));
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if (!queue.deques || !workers || !threads)
+	{
+		fprintf(stderr, "batch: out of memory\n");
+		goto out;
+	}
+
+	for (i = 0; i < nthreads; i++)
+	{
+		if (deque_init(&queue.deques[i], njobs) != 0)
+		{
+			fprintf(stderr, "batch: out of memory\n");
+			goto out;
+		}
+		queue.nworkers++;
+		workers[i].queue = &queue;
+		workers[i].id = i;
+	}
+	for (i = 0; i < njobs; i++)
+		deque_push_bottom(&queue.deques[i % nthreads], i);
+
+	//worker 0 is this thread
+	started = 1;
+	for (i = 1; i < nthreads; i++)
+	{
+		if (pthread_create(&threads[i], NULL, batch_worker, &workers[i]) != 0)
+			break;
+		started++;
+	}
+	batch_worker(&workers[0]);
+
+	for (i = 1; i < started; i++)
+		pthread_join(threads[i], NULL);
+	ret = 0;
+
+out:
+	for (i = 0; ret != 0 && i < njobs; i++)
+		jobs[i].status = -2;
+	for (i = 0; queue.deques && i < queue.nworkers; i++)
+		deque_free(&queue.deques[i]);
+	free(queue.deques);
+	free(workers);
+	free(threads);
+	pthread_cond_destroy(&queue.wake);
+	pthread_mutex_destroy(&queue.lock);
+	return ret;
+}
+
+void batch_report(FILE *fp, BatchJob *jobs, int njobs)
+{
+	X86Cpu *cpu;
+	int i;
+
+	for (i = 0; i < njobs; i++)
+	{
+		cpu = &jobs[i].final;
+		if (jobs[i].status != 0)
+		{
+			fprintf(fp, "%s: %s\n", jobs[i].path,
+				jobs[i].status == -2 ? "not run" : "load failed");
+			continue;
+		}
+		fprintf(fp, "%s: %s insns=%llu cycles=%llu slices=%d CS:IP=%.4X:%.4X "
+			"AX=%.4X BX=%.4X CX=%.4X DX=%.4X FL=%.4X\n", jobs[i].path,
+			cpu->running ? "done" : "halted",
+			(unsigned long long)cpu->insns,
+			(unsigned long long)cpu->cycles, jobs[i].slices, cpu->cs, cpu->ip,
+			cpu->ax.w, cpu->bx.w, cpu->cx.w, cpu->dx.w, cpu->flags);
+	}
+}
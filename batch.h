@@ -0,0 +1,41 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include "intel8086.h"
+
+//default time slice, about 20ms of a 4.77MHz 5150
+#define BATCH_SLICE 100000
+
+/* One independent emulator run.  Each job gets its own X86Cpu so workers
+ * share nothing but the job array; a job runs for a slice of cycles at a time
+ * and goes back on a queue until it halts or uses up its instructions. */
+typedef struct {
+	char *path;		//BIOS image or snapshot
+	int status;		//0 ok, -1 couldn't load, -2 never run
+	X86Cpu *cpu;		//live while the job is in progress
+	uint64_t limit;		//stop once cpu->insns gets here
+	int slices;
+	X86Cpu final;		//registers when the run ended, ram is NULL
+} BatchJob;
+
+int batch_read_list(char *filename, BatchJob **jobs);
+void batch_free(BatchJob *jobs, int njobs);
+int batch_run(BatchJob *jobs, int njobs, int nthreads, uint64_t instructions,
+	uint64_t slice);
+void batch_report(FILE *fp, BatchJob *jobs, int njobs);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "acorn.h"
+
+/* Instruction level microbenchmarks.  Each kernel is a small guest loop that
+ * runs until the cycle budget is used up; a repetition is timed on the host
+ * and the median of all repetitions is reported so one noisy run doesn't
+ * move the numbers.  Kernels using opcodes the core doesn't have yet halt on
+ * the first one and are reported as unsupported. */
+#define BENCH_CYCLES 20000000
+#define BENCH_REPS 5
+#define CODE_SEG 0x1000
+#define DATA_SEG 0x3000
+#define PC_HZ 4772727
+
+typedef struct {
+	char *name;
+	uint8_t code[64];
+	int len;
+	uint16_t flags;		//initial flags, the loop closes with JNC
+	uint16_t far;		//if set, a second block at far:0000 jumps back
+} BenchKernel;
+
+typedef struct {
+	BenchKernel *kernel;
+	int supported;
+	uint64_t insns, cycles;
+	double secs;		//median
+	double min, max;
+} BenchResult;
+
+static BenchKernel kernels[] = {
+	{ "mov", {
+		0xB0, 0x01,		//MOV AL,1
+		0xB4, 0x02,		//MOV AH,2
+		0xB3, 0x03,		//MOV BL,3
+		0xB7, 0x04,		//MOV BH,4
+		0xB9, 0x34, 0x12,	//MOV CX,1234
+		0xBA, 0x78, 0x56,	//MOV DX,5678
+		0xBE, 0x00, 0x01,	//MOV SI,100
+		0xBF, 0x00, 0x02,	//MOV DI,200
+	}, 20, 0 },
+	{ "jcc", {
+		0x75, 0x00,		//JNE, not taken
+		0x73, 0x00,		//JNC, taken
+		0x79, 0x00,		//JNS, taken
+		0x7B, 0x00,		//JNP, taken
+		0x75, 0x00,
+		0x73, 0x00,
+	}, 12, 0x0040 },
+	{ "string", {
+		0xFC,			//CLD
+		0xB9, 0x00, 0x01,	//MOV CX,100
+		0xBE, 0x00, 0x00,	//MOV SI,0
+		0xBF, 0x00, 0x10,	//MOV DI,1000
+		0xF3, 0xA4,		//REP MOVSB
+		0xB9, 0x80, 0x00,	//MOV CX,80
+		0xF3, 0xAB,		//REP STOSW
+		0xB9, 0x00, 0x01,	//MOV CX,100
+		0xBE, 0x00, 0x00,	//MOV SI,0
+		0xF3, 0xAC,		//REP LODSB
+		0xB9, 0x00, 0x01,	//MOV CX,100
+		0xBF, 0x00, 0x10,	//MOV DI,1000
+		0xB0, 0xFF,		//MOV AL,FF
+		0xF2, 0xAE,		//REPNE SCASB
+	}, 35, 0 },
+	{ "muldiv", {
+		0xB8, 0x34, 0x12,	//MOV AX,1234
+		0xBB, 0x07, 0x00,	//MOV BX,7
+		0xF7, 0xE3,		//MUL BX
+		0xBA, 0x00, 0x00,	//MOV DX,0
+		0xF7, 0xF3,		//DIV BX
+		0xF6, 0xE3,		//MUL BL
+		0xF6, 0xF3,		//DIV BL
+		0xB4, 0x00,		//MOV AH,0
+		0x9E,			//SAHF, clears CF for the JNC
+	}, 20, 0 },
+	{ "farjmp", {
+		0xEA, 0x00, 0x00, 0x00, 0x20,	//JMP 2000:0000
+	}, 5, 0, 0x2000 },
+};
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void load_kernel(AcornEmu *emu, BenchKernel *k)
+{
+	uint8_t code[80];
+	uint8_t back[5] = { 0xEA, 0x00, 0x00, CODE_SEG & 0xFF, CODE_SEG >> 8 };
+	AcornRegs regs;
+	int len = k->len;
+
+	memcpy(code, k->code, len);
+	if (!k->far)
+	{
+		//close the loop with JNC back to the start
+		code[len] = 0x73;
+		code[len + 1] = (uint8_t)-(len + 2);
+		len += 2;
+	}
+	acorn_write_mem(emu, CODE_SEG << 4, code, len);
+	if (k->far)
+		acorn_write_mem(emu, k->far << 4, back, sizeof(back));
+
+	memset(&regs, 0, sizeof(regs));
+	regs.cs = CODE_SEG;
+	regs.ds = regs.es = regs.ss = DATA_SEG;
+	regs.sp = 0xFFFE;
+	regs.flags = k->flags;
+	acorn_set_regs(emu, &regs);
+}
+
+static int run_kernel(BenchKernel *k, BenchResult *res, uint64_t cycles,
+	int reps)
+{
+	AcornEmu *emu;
+	AcornRegs regs;
+	double times[reps], start;
+	int i;
+
+	memset(res, 0, sizeof(BenchResult));
+	res->kernel = k;
+
+	for (i = 0; i < reps; i++)
+	{
+		emu = acorn_create();
+		if (emu == NULL)
+			return -1;
+		load_kernel(emu, k);
+
+		start = now();
+		acorn_run(emu, cycles);
+		times[i] = now() - start;
+
+		acorn_get_regs(emu, &regs);
+		acorn_destroy(emu);
+		if (!regs.running)
+			return 0;
+		res->insns = regs.insns;
+		res->cycles = regs.cycles;
+	}
+
+	qsort(times, reps, sizeof(double), cmp_double);
+	res->supported = 1;
+	res->secs = times[reps / 2];
+	res->min = times[0];
+	res->max = times[reps - 1];
+	return 0;
+}
+
+static void report_text(BenchResult *res, int n)
+{
+	int i;
+
+	printf("%-8s %10s %10s %14s %10s %8s\n", "kernel", "MIPS", "ns/insn",
+		"cycles/s", "x5150", "spread");
+	for (i = 0; i < n; i++)
+	{
+		if (!res[i].supported)
+		{
+			printf("%-8s %10s\n", res[i].kernel->name, "unsupported");
+			continue;
+		}
+		printf("%-8s %10.2f %10.2f %14.0f %10.1f %7.1f%%\n",
+			res[i].kernel->name,
+			res[i].insns / res[i].secs / 1e6,
+			res[i].secs * 1e9 / res[i].insns,
+			res[i].cycles / res[i].secs,
+			res[i].cycles / res[i].secs / PC_HZ,
+			(res[i].max - res[i].min) * 100 / res[i].secs);
+	}
+}
+
+//a JSON string, the label may come from anywhere, a git branch name say
+static void json_string(const char *str)
+{
+	const unsigned char *p;
+
+	putchar('"');
+	for (p = (const unsigned char *)str; *p; p++)
+	{
+		if (*p == '"' || *p == '\\')
+			printf("\\%c", *p);
+		else if (*p < 0x20)
+			printf("\\u%04x", *p);
+		else
+			putchar(*p);
+	}
+	putchar('"');
+}
+
+static void report_json(BenchResult *res, int n, char *label, uint64_t cycles,
+	int reps)
+{
+	int i;
+
+	printf("{\n  \"label\": ");
+	json_string(label);
+	printf(",\n  \"cycles\": %llu,\n  \"reps\": %d,\n"
+		"  \"kernels\": [\n", (unsigned long long)cycles, reps);
+	for (i = 0; i < n; i++)
+	{
+		printf("    { \"name\": \"%s\", \"supported\": %s", res[i].kernel->name,
+			res[i].supported ? "true" : "false");
+		if (res[i].supported)
+			printf(", \"insns\": %llu, \"cycles\": %llu, \"seconds\": %.6f, "
+				"\"mips\": %.3f, \"ns_per_insn\": %.3f, "
+				"\"cycles_per_sec\": %.0f, \"min_seconds\": %.6f, "
+				"\"max_seconds\": %.6f",
+				(unsigned long long)res[i].insns,
+				(unsigned long long)res[i].cycles, res[i].secs,
+				res[i].insns / res[i].secs / 1e6,
+				res[i].secs * 1e9 / res[i].insns,
+				res[i].cycles / res[i].secs, res[i].min, res[i].max);
+		printf(" }%s\n", i + 1 < n ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+static void usage(char *name)
+{
+	fprintf(stderr, "usage: %s [-j] [-l label] [-c cycles] [-r reps] "
+		"[kernel...]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	BenchResult res[NKERNELS];
+	uint64_t cycles = BENCH_CYCLES;
+	int reps = BENCH_REPS;
+	char *label = "";
+	int json = 0;
+	int opt, n, i, j;
+
+	while ((opt = getopt(argc, argv, "jl:c:r:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+				json = 1;
+				break;
+			case 'l':
+				label = optarg;
+				break;
+			case 'c':
+				cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'r':
+				reps = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (reps < 1 || cycles == 0)
+		usage(argv[0]);
+
+	n = 0;
+	for (i = 0; i < NKERNELS; i++)
+	{
+		//no names means every kernel
+		for (j = optind; j < argc; j++)
+			if (strcmp(argv[j], kernels[i].name) == 0)
+				break;
+		if (optind < argc && j == argc)
+			continue;
+
+		if (run_kernel(&kernels[i], &res[n], cycles, reps) != 0)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		n++;
+	}
+
+	if (json)
+		report_json(res, n, label, cycles, reps);
+	else
+		report_text(res, n);
+
+	return 0;
+}
@@ -0,0 +1,754 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "opcode.h"
+#include "bios.h"
+#include "floppy.h"
+#include "hdimage.h"
+#include "dos.h"
+
+//BIOS data area, as linear addresses
+#define BDA_EQUIPMENT	0x410
+#define BDA_MEM_SIZE	0x413
+#define BDA_KBD_FLAGS	0x417
+#define BDA_KBD_HEAD	0x41A
+#define BDA_KBD_TAIL	0x41C
+#define BDA_KBD_BUF	0x41E
+#define BDA_KBD_END	0x43E
+#define BDA_DISK_STATUS	0x441
+#define BDA_VIDEO_MODE	0x449
+#define BDA_COLUMNS	0x44A
+#define BDA_PAGE_SIZE	0x44C
+#define BDA_PAGE_START	0x44E
+#define BDA_CURSOR	0x450	//column and row for each of 8 pages
+#define BDA_CURSOR_TYPE	0x460
+#define BDA_PAGE	0x462
+#define BDA_CRTC	0x463
+#define BDA_MODE_REG	0x465
+#define BDA_PALETTE	0x466
+#define BDA_TICKS	0x46C
+#define BDA_MIDNIGHT	0x470
+#define BDA_HD_STATUS	0x474
+#define BDA_HD_COUNT	0x475
+
+#define TEXT_ROWS 25
+
+//shift state bits in BDA_KBD_FLAGS
+#define KBD_RSHIFT	0x01
+#define KBD_LSHIFT	0x02
+#define KBD_CTRL	0x04
+#define KBD_ALT		0x08
+
+//INT 13h status codes
+#define DISK_OK		0x00
+#define DISK_BAD_CMD	0x01
+#define DISK_NOT_FOUND	0x04
+#define DISK_WRITE_FAULT 0x0A
+#define DISK_TIMEOUT	0x80
+
+//6845 registers 0-15 for 40x25, 80x25, graphics and monochrome
+static const uint8_t crtc_parms[4][16] = {
+	{ 0x38, 0x28, 0x2D, 0x0A, 0x1F, 0x06, 0x19, 0x1C,
+	  0x02, 0x07, 0x06, 0x07, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x71, 0x50, 0x5A, 0x0A, 0x1F, 0x06, 0x19, 0x1C,
+	  0x02, 0x07, 0x06, 0x07, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x38, 0x28, 0x2D, 0x0A, 0x7F, 0x06, 0x64, 0x70,
+	  0x02, 0x01, 0x06, 0x07, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x61, 0x50, 0x52, 0x0F, 0x19, 0x06, 0x19, 0x19,
+	  0x02, 0x0D, 0x0B, 0x0C, 0x00, 0x00, 0x00, 0x00 },
+};
+//per mode: CRTC table, mode register, columns
+static const uint8_t mode_parms[8][3] = {
+	{ 0, 0x2C, 40 }, { 0, 0x28, 40 }, { 1, 0x2D, 80 }, { 1, 0x29, 80 },
+	{ 2, 0x2A, 40 }, { 2, 0x2E, 40 }, { 2, 0x1E, 80 }, { 3, 0x29, 80 },
+};
+//characters for scan codes 00h-39h, plain and shifted, 0 for none
+#define SCAN_KEYS 0x3A
+static const char scan_ascii[2][SCAN_KEYS + 1] = {
+	"\0\x1b" "1234567890-=\b\t" "qwertyuiop[]\r\0"
+	"asdfghjkl;'`\0\\" "zxcvbnm,./\0*\0 ",
+	"\0\x1b" "!@#$%^&*()_+\b\t" "QWERTYUIOP{}\r\0"
+	"ASDFGHJKL:\"~\0|" "ZXCVBNM<>?\0*\0 ",
+};
+
+static uint8_t bda8(X86Cpu *cpu, uint32_t addr)
+{
+	return mem_read8(cpu, addr);
+}
+
+static uint16_t bda16(X86Cpu *cpu, uint32_t addr)
+{
+	return mem_read16(cpu, 0, addr);
+}
+
+static void set_bda8(X86Cpu *cpu, uint32_t addr, uint8_t val)
+{
+	mem_write8(cpu, addr, val);
+}
+
+static void set_bda16(X86Cpu *cpu, uint32_t addr, uint16_t val)
+{
+	mem_write16(cpu, 0, addr, val);
+}
+
+static void set_cf(X86Cpu *cpu, int on)
+{
+	if (on)
+		set_flag(cpu, FLAGS_CF);
+	else
+		clear_flag(cpu, FLAGS_CF);
+}
+
+/* Guest memory in and out for the disk services, straight through
+ * cpu->ram when the whole buffer is plain RAM, as DMA does. */
+static void copy_in(X86Cpu *cpu, uint32_t addr, const uint8_t *src,
+	uint32_t len)
+{
+	uint32_t i;
+
+	if (addr + len <= RAM_SIZE && mem_range_is(cpu, addr, len, 1))
+	{
+		memcpy(&cpu->ram[addr], src, len);
+		mem_dirty(cpu, addr, len);
+		return;
+	}
+	for (i = 0; i < len; i++)
+		mem_write8(cpu, addr + i, src[i]);
+}
+
+static void copy_out(X86Cpu *cpu, uint32_t addr, uint8_t *dst, uint32_t len)
+{
+	uint32_t i;
+
+	if (addr + len <= RAM_SIZE && mem_range_is(cpu, addr, len, 0))
+	{
+		memcpy(dst, &cpu->ram[addr], len);
+		return;
+	}
+	for (i = 0; i < len; i++)
+		dst[i] = mem_read8(cpu, addr + i);
+}
+
+/*
+ * INT 10h
+ */
+
+static int text_mode(X86Cpu *cpu)
+{
+	uint8_t mode = bda8(cpu, BDA_VIDEO_MODE);
+
+	return mode <= 3 || mode == 7;
+}
+
+static uint32_t text_cell(X86Cpu *cpu, int page, int row, int col)
+{
+	uint32_t base = bda8(cpu, BDA_VIDEO_MODE) == 7 ? VIDEO_MDA_BASE
+		: VIDEO_CGA_BASE;
+
+	return base + page * bda16(cpu, BDA_PAGE_SIZE)
+		+ (row * bda16(cpu, BDA_COLUMNS) + col) * 2;
+}
+
+static void crtc_write(X86Cpu *cpu, uint8_t reg, uint8_t val)
+{
+	uint16_t port = bda16(cpu, BDA_CRTC);
+
+	io_write8(cpu, port, reg);
+	io_write8(cpu, port + 1, val);
+}
+
+//the hardware cursor follows the active page's
+static void set_cursor(X86Cpu *cpu, int page, int row, int col)
+{
+	uint16_t pos;
+
+	set_bda8(cpu, BDA_CURSOR + page * 2, col);
+	set_bda8(cpu, BDA_CURSOR + page * 2 + 1, row);
+	if (page != bda8(cpu, BDA_PAGE))
+		return;
+	pos = bda16(cpu, BDA_PAGE_START) / 2 + row * bda16(cpu, BDA_COLUMNS)
+		+ col;
+	crtc_write(cpu, 14, pos >> 8);
+	crtc_write(cpu, 15, pos & 0xFF);
+}
+
+static void fill_cells(X86Cpu *cpu, uint32_t addr, int count, uint8_t ch,
+	uint8_t attr)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		cpu->ram[addr + i * 2] = ch;
+		cpu->ram[addr + i * 2 + 1] = attr;
+	}
+	mem_dirty(cpu, addr, count * 2);
+}
+
+//AH=06h/07h, n of 0 blanks the whole window
+static void scroll(X86Cpu *cpu, int up, int n, uint8_t attr, int top,
+	int left, int bottom, int right)
+{
+	int page = bda8(cpu, BDA_PAGE);
+	int cols = bda16(cpu, BDA_COLUMNS);
+	int height, width, i, dst;
+	uint32_t to, from;
+
+	if (right >= cols)
+		right = cols - 1;
+	if (bottom >= TEXT_ROWS)
+		bottom = TEXT_ROWS - 1;
+	if (top > bottom || left > right)
+		return;
+	height = bottom - top + 1;
+	width = right - left + 1;
+	if (n == 0 || n > height)
+		n = height;
+	for (i = 0; i < height - n; i++)
+	{
+		dst = up ? top + i : bottom - i;
+		to = text_cell(cpu, page, dst, left);
+		from = text_cell(cpu, page, up ? dst + n : dst - n, left);
+		memmove(&cpu->ram[to], &cpu->ram[from], width * 2);
+		mem_dirty(cpu, to, width * 2);
+	}
+	for (; i < height; i++)
+		fill_cells(cpu, text_cell(cpu, page, up ? top + i : bottom - i,
+			left), width, ' ', attr);
+}
+
+static void teletype(X86Cpu *cpu, uint8_t ch)
+{
+	int page = bda8(cpu, BDA_PAGE);
+	int col = bda8(cpu, BDA_CURSOR + page * 2);
+	int row = bda8(cpu, BDA_CURSOR + page * 2 + 1);
+	int cols = bda16(cpu, BDA_COLUMNS);
+	uint32_t cell;
+
+	switch (ch)
+	{
+		case 0x07:
+			break;
+		case 0x08:
+			if (col > 0)
+				col--;
+			break;
+		case 0x0A:
+			row++;
+			break;
+		case 0x0D:
+			col = 0;
+			break;
+		default:
+			mem_write8(cpu, text_cell(cpu, page, row, col), ch);
+			if (++col == cols)
+			{
+				col = 0;
+				row++;
+			}
+	}
+	if (row == TEXT_ROWS)
+	{
+		//the new line takes the attribute under the cursor
+		row--;
+		cell = text_cell(cpu, page, row, col);
+		scroll(cpu, 1, 1, mem_read8(cpu, cell + 1), 0, 0, row, cols - 1);
+	}
+	set_cursor(cpu, page, row, col);
+}
+
+static int set_mode(X86Cpu *cpu, uint8_t mode)
+{
+	int mda = cpu->video.adapter == VIDEO_MDA;
+	uint16_t port = mda ? VIDEO_MDA_PORT : VIDEO_CGA_PORT;
+	const uint8_t *p;
+	uint32_t base = mda ? VIDEO_MDA_BASE : VIDEO_CGA_BASE;
+	uint32_t size = mda ? VIDEO_MDA_SIZE : VIDEO_CGA_SIZE;
+	int clear = !(mode & 0x80), i;
+
+	mode &= 0x7F;
+	//a mode the adapter cannot show is left alone
+	if (mode > 7 || (mode == 7) != mda)
+		return 1;
+	p = mode_parms[mode];
+
+	io_write8(cpu, port + 8, p[1] & ~VIDEO_MODE_ENABLE);
+	set_bda8(cpu, BDA_VIDEO_MODE, mode);
+	set_bda16(cpu, BDA_CRTC, port + 4);
+	for (i = 0; i < 16; i++)
+		crtc_write(cpu, i, crtc_parms[p[0]][i]);
+	if (clear && mode >= 4 && mode <= 6)
+	{
+		memset(&cpu->ram[base], 0, size);
+		mem_dirty(cpu, base, size);
+	}
+	else if (clear)
+		fill_cells(cpu, base, size / 2, ' ', 0x07);
+	if (!mda)
+		io_write8(cpu, port + 9, mode == 6 ? 0x3F : 0x30);
+	io_write8(cpu, port + 8, p[1]);
+
+	set_bda16(cpu, BDA_COLUMNS, p[2]);
+	set_bda16(cpu, BDA_PAGE_SIZE, mode >= 4 && mode <= 6 ? 0x4000
+		: p[2] == 40 ? 0x800 : 0x1000);
+	set_bda16(cpu, BDA_PAGE_START, 0);
+	for (i = 0; i < 16; i++)
+		set_bda8(cpu, BDA_CURSOR + i, 0);
+	set_bda16(cpu, BDA_CURSOR_TYPE, mda ? 0x0B0C : 0x0607);
+	set_bda8(cpu, BDA_PAGE, 0);
+	set_bda8(cpu, BDA_MODE_REG, p[1]);
+	set_bda8(cpu, BDA_PALETTE, mode == 6 ? 0x3F : 0x30);
+	return 1;
+}
+
+static int int10(X86Cpu *cpu)
+{
+	int page = cpu->bx.h & 7;
+	uint32_t cell;
+	uint16_t start;
+	int i;
+
+	switch (cpu->ax.h)
+	{
+		case 0x00:
+			return set_mode(cpu, cpu->ax.l);
+		case 0x01:
+			set_bda16(cpu, BDA_CURSOR_TYPE, cpu->cx.w);
+			crtc_write(cpu, 10, cpu->cx.h);
+			crtc_write(cpu, 11, cpu->cx.l);
+			return 1;
+		case 0x02:
+			set_cursor(cpu, page, cpu->dx.h, cpu->dx.l);
+			return 1;
+		case 0x03:
+			cpu->dx.l = bda8(cpu, BDA_CURSOR + page * 2);
+			cpu->dx.h = bda8(cpu, BDA_CURSOR + page * 2 + 1);
+			cpu->cx.w = bda16(cpu, BDA_CURSOR_TYPE);
+			return 1;
+		case 0x05:
+			if (!text_mode(cpu))
+				return 0;
+			page = cpu->ax.l & 7;
+			start = page * bda16(cpu, BDA_PAGE_SIZE);
+			set_bda8(cpu, BDA_PAGE, page);
+			set_bda16(cpu, BDA_PAGE_START, start);
+			crtc_write(cpu, 12, start / 2 >> 8);
+			crtc_write(cpu, 13, start / 2 & 0xFF);
+			set_cursor(cpu, page, bda8(cpu, BDA_CURSOR + page * 2 + 1),
+				bda8(cpu, BDA_CURSOR + page * 2));
+			return 1;
+		case 0x06:
+		case 0x07:
+			if (!text_mode(cpu))
+				return 0;
+			scroll(cpu, cpu->ax.h == 0x06, cpu->ax.l, cpu->bx.h,
+				cpu->cx.h, cpu->cx.l, cpu->dx.h, cpu->dx.l);
+			return 1;
+		case 0x08:
+			if (!text_mode(cpu))
+				return 0;
+			cell = text_cell(cpu, page,
+				bda8(cpu, BDA_CURSOR + page * 2 + 1),
+				bda8(cpu, BDA_CURSOR + page * 2));
+			cpu->ax.l = mem_read8(cpu, cell);
+			cpu->ax.h = mem_read8(cpu, cell + 1);
+			return 1;
+		case 0x09:
+		case 0x0A:
+			if (!text_mode(cpu))
+				return 0;
+			cell = text_cell(cpu, page,
+				bda8(cpu, BDA_CURSOR + page * 2 + 1),
+				bda8(cpu, BDA_CURSOR + page * 2));
+			for (i = 0; i < cpu->cx.w; i++)
+			{
+				mem_write8(cpu, cell + i * 2, cpu->ax.l);
+				if (cpu->ax.h == 0x09)
+					mem_write8(cpu, cell + i * 2 + 1, cpu->bx.l);
+			}
+			return 1;
+		case 0x0E:
+			if (!text_mode(cpu))
+				return 0;
+			teletype(cpu, cpu->ax.l);
+			return 1;
+		case 0x0F:
+			cpu->ax.l = bda8(cpu, BDA_VIDEO_MODE);
+			cpu->ax.h = bda16(cpu, BDA_COLUMNS);
+			cpu->bx.h = bda8(cpu, BDA_PAGE);
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * INT 13h
+ */
+
+static void disk_status(X86Cpu *cpu, int hd, uint8_t status)
+{
+	set_bda8(cpu, hd ? BDA_HD_STATUS : BDA_DISK_STATUS, status);
+	cpu->ax.h = status;
+	set_cf(cpu, status != DISK_OK);
+}
+
+/* AH=02h-04h on a floppy.  Sectors run on past the end of a track to the
+ * next head and cylinder, as the ROM's multi-track reads do. */
+static uint8_t floppy_rw(X86Cpu *cpu, FloppyImage *img, int op)
+{
+	uint32_t addr = ((cpu->es << 4) + cpu->bx.w) & MEM_MASK;
+	int c = cpu->cx.h, h = cpu->dx.h, s = cpu->cx.l;
+	int left = cpu->ax.l, n, run;
+	const uint8_t *src;
+	uint8_t *dst;
+
+	cpu->ax.l = 0;
+	if (img->base == NULL)
+		return DISK_TIMEOUT;
+	while (left > 0)
+	{
+		src = floppy_read(img, c, h, s, &run);
+		if (src == NULL)
+			return DISK_NOT_FOUND;
+		n = run < left ? run : left;
+		if (op == 0x02)
+			copy_in(cpu, addr, src, n * FLOPPY_SECTOR);
+		else if (op == 0x03)
+		{
+			n = 1;
+			dst = floppy_write(img, c, h, s);
+			if (dst == NULL)
+				return DISK_WRITE_FAULT;
+			copy_out(cpu, addr, dst, FLOPPY_SECTOR);
+		}
+		if (op != 0x04)
+			addr += n * FLOPPY_SECTOR;
+		cpu->ax.l += n;
+		left -= n;
+		s += n;
+		if (s > img->sectors)
+		{
+			s = 1;
+			if (++h == img->heads)
+			{
+				h = 0;
+				c++;
+			}
+		}
+	}
+	return DISK_OK;
+}
+
+static uint8_t hd_rw(X86Cpu *cpu, HdImage *img, int op)
+{
+	uint32_t addr = ((cpu->es << 4) + cpu->bx.w) & MEM_MASK;
+	uint32_t cyl = cpu->cx.h | (cpu->cx.l & 0xC0) << 2;
+	uint32_t lba, run;
+	int left = cpu->ax.l, n;
+	const uint8_t *src;
+	uint8_t *dst;
+
+	cpu->ax.l = 0;
+	if (img->base == NULL)
+		return DISK_TIMEOUT;
+	if (cyl >= img->hdr.cylinders || cpu->dx.h >= img->hdr.heads
+		|| (cpu->cx.l & 0x3F) == 0 || (cpu->cx.l & 0x3F) > HD_SECTORS)
+		return DISK_NOT_FOUND;
+	lba = (cyl * img->hdr.heads + cpu->dx.h) * HD_SECTORS
+		+ (cpu->cx.l & 0x3F) - 1;
+	while (left > 0)
+	{
+		src = hd_read(img, lba, &run);
+		if (src == NULL)
+			return DISK_NOT_FOUND;
+		n = (int)run < left ? (int)run : left;
+		if (op == 0x02)
+			copy_in(cpu, addr, src, n * HD_SECTOR);
+		else if (op == 0x03)
+		{
+			n = 1;
+			dst = hd_write(img, lba);
+			if (dst == NULL)
+				return DISK_WRITE_FAULT;
+			copy_out(cpu, addr, dst, HD_SECTOR);
+			if (hd_flush(img, lba) != 0)
+				return DISK_WRITE_FAULT;
+		}
+		if (op != 0x04)
+			addr += n * HD_SECTOR;
+		cpu->ax.l += n;
+		left -= n;
+		lba += n;
+	}
+	return DISK_OK;
+}
+
+static int int13(X86Cpu *cpu)
+{
+	int hd = cpu->dx.l >= 0x80;
+	int drive = cpu->dx.l & 0x7F;
+	FloppyImage *fimg = NULL;
+	HdImage *himg = NULL;
+	uint16_t cyl;
+	int i, count;
+
+	if (hd ? drive >= HD_DRIVES : drive >= FLOPPY_DRIVES)
+	{
+		disk_status(cpu, hd, DISK_TIMEOUT);
+		return 1;
+	}
+	if (hd)
+		himg = &cpu->hdisk->drive[drive];
+	else
+		fimg = &cpu->floppy->drive[drive];
+
+	switch (cpu->ax.h)
+	{
+		case 0x00:
+			disk_status(cpu, hd, DISK_OK);
+			return 1;
+		case 0x01:
+			cpu->ax.l = bda8(cpu, hd ? BDA_HD_STATUS : BDA_DISK_STATUS);
+			disk_status(cpu, hd, DISK_OK);
+			return 1;
+		case 0x02:
+		case 0x03:
+		case 0x04:
+			disk_status(cpu, hd, hd ? hd_rw(cpu, himg, cpu->ax.h)
+				: floppy_rw(cpu, fimg, cpu->ax.h));
+			return 1;
+		case 0x08:
+			if (!hd)
+			{
+				disk_status(cpu, hd, DISK_BAD_CMD);
+				return 1;
+			}
+			if (himg->base == NULL)
+			{
+				disk_status(cpu, hd, DISK_TIMEOUT);
+				return 1;
+			}
+			for (i = count = 0; i < HD_DRIVES; i++)
+				count += cpu->hdisk->drive[i].base != NULL;
+			set_bda8(cpu, BDA_HD_COUNT, count);
+			cyl = himg->hdr.cylinders - 1;
+			cpu->cx.h = cyl & 0xFF;
+			cpu->cx.l = (cyl >> 2 & 0xC0) | HD_SECTORS;
+			cpu->dx.h = himg->hdr.heads - 1;
+			cpu->dx.l = count;
+			disk_status(cpu, hd, DISK_OK);
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * INT 16h and 1Ah
+ */
+
+static void shift_key(X86Cpu *cpu, uint8_t bit, int down)
+{
+	uint8_t flags = bda8(cpu, BDA_KBD_FLAGS);
+
+	set_bda8(cpu, BDA_KBD_FLAGS, down ? flags | bit : flags & ~bit);
+}
+
+/* IRQ 1: take the scan code off the PPI, keep track of shift, ctrl and alt
+ * and put key presses in the buffer as scan code and character, as the ROM
+ * does for the keys it knows.  Nothing comes back from a full buffer. */
+static int int09(X86Cpu *cpu)
+{
+	uint8_t code = io_read8(cpu, PPI_PORT);
+	uint8_t key = code & 0x7F, flags, ch = 0;
+	uint16_t tail = bda16(cpu, BDA_KBD_TAIL), next;
+	uint8_t port_b = io_read8(cpu, PPI_PORT + 1);
+
+	//acknowledge by pulsing the latch clear, then end of interrupt
+	io_write8(cpu, PPI_PORT + 1, port_b | PPI_B_KBD_CLEAR);
+	io_write8(cpu, PPI_PORT + 1, port_b);
+	io_write8(cpu, PIC_PORT, 0x20);
+
+	switch (key)
+	{
+		case 0x2A: shift_key(cpu, KBD_LSHIFT, !(code & 0x80)); return 1;
+		case 0x36: shift_key(cpu, KBD_RSHIFT, !(code & 0x80)); return 1;
+		case 0x1D: shift_key(cpu, KBD_CTRL, !(code & 0x80)); return 1;
+		case 0x38: shift_key(cpu, KBD_ALT, !(code & 0x80)); return 1;
+	}
+	if (code & 0x80)
+		return 1;
+	flags = bda8(cpu, BDA_KBD_FLAGS);
+	if (key < SCAN_KEYS && !(flags & KBD_ALT))
+		ch = scan_ascii[(flags & (KBD_LSHIFT | KBD_RSHIFT)) != 0][key];
+	if ((flags & KBD_CTRL) && ch >= '@')
+		ch &= 0x1F;
+
+	next = tail + 2;
+	if (BIOS_DATA + next == BDA_KBD_END)
+		next = BDA_KBD_BUF - BIOS_DATA;
+	if (next == bda16(cpu, BDA_KBD_HEAD))
+		return 1;
+	set_bda16(cpu, BIOS_DATA + tail, key << 8 | ch);
+	set_bda16(cpu, BDA_KBD_TAIL, next);
+	return 1;
+}
+
+static int int16(X86Cpu *cpu)
+{
+	uint16_t head = bda16(cpu, BDA_KBD_HEAD);
+
+	switch (cpu->ax.h)
+	{
+		case 0x00:
+			if (head == bda16(cpu, BDA_KBD_TAIL))
+			{
+				/* Nothing typed yet.  Come back to the INT 16h once
+				 * the keyboard interrupt has had its chance, skipping
+				 * the time in between rather than spinning through
+				 * it.  With interrupts off only the ROM can wait. */
+				if (!FLAG_TST(FLAGS_INT)
+					|| mem_read8(cpu, PC - 2) != 0xCD
+					|| mem_read8(cpu, PC - 1) != 0x16)
+					return 0;
+				cpu->ip -= 2;
+				if (cpu->cycles < cpu->next_event)
+					cpu->cycles = cpu->next_event;
+				return 1;
+			}
+			cpu->ax.w = bda16(cpu, BIOS_DATA + head);
+			head += 2;
+			if (BIOS_DATA + head == BDA_KBD_END)
+				head = BDA_KBD_BUF - BIOS_DATA;
+			set_bda16(cpu, BDA_KBD_HEAD, head);
+			return 1;
+		case 0x01:
+			if (head == bda16(cpu, BDA_KBD_TAIL))
+			{
+				set_flag(cpu, FLAGS_ZF);
+				return 1;
+			}
+			cpu->ax.w = bda16(cpu, BIOS_DATA + head);
+			clear_flag(cpu, FLAGS_ZF);
+			return 1;
+		case 0x02:
+			cpu->ax.l = bda8(cpu, BDA_KBD_FLAGS);
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static int int1a(X86Cpu *cpu)
+{
+	switch (cpu->ax.h)
+	{
+		case 0x00:
+			cpu->dx.w = bda16(cpu, BDA_TICKS);
+			cpu->cx.w = bda16(cpu, BDA_TICKS + 2);
+			cpu->ax.l = bda8(cpu, BDA_MIDNIGHT);
+			set_bda8(cpu, BDA_MIDNIGHT, 0);
+			return 1;
+		case 0x01:
+			set_bda16(cpu, BDA_TICKS, cpu->dx.w);
+			set_bda16(cpu, BDA_TICKS + 2, cpu->cx.w);
+			set_bda8(cpu, BDA_MIDNIGHT, 0);
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static int service(X86Cpu *cpu, uint8_t vector)
+{
+	switch (vector)
+	{
+		case 0x09:
+			return int09(cpu);
+		case 0x10:
+			return int10(cpu);
+		case 0x13:
+			return int13(cpu);
+		case 0x16:
+			return int16(cpu);
+		case 0x1A:
+			return int1a(cpu);
+		case 0x20:
+		case 0x21:
+			return dos_hle(cpu, vector);
+		default:
+			return 0;
+	}
+}
+
+/* Called from interrupt() for trapped vectors, before anything is pushed.
+ * Returns 0 to let the handler in the IVT run after all.  Results come
+ * back in the registers and in FLAGS directly, there is no IRET. */
+int bios_hle(X86Cpu *cpu, uint8_t vector)
+{
+	if (mem_read16(cpu, 0, vector * 4 + 2) < BIOS_ROM_SEG)
+		return 0;
+	return service(cpu, vector);
+}
+
+/* BIOS_TRAP_OP vv, reached by running the stub in ROM, which a guest that
+ * hooked the vector does when it chains on to the address it saved.  This
+ * time the interrupt frame is on the stack and an IRET follows, so the
+ * result flags are merged into the stacked FLAGS for it to pop. */
+void bios_trap_op(X86Cpu *cpu)
+{
+	const uint16_t result = FLAGS_CF | FLAGS_PF | FLAGS_AF | FLAGS_ZF
+		| FLAGS_SF | FLAGS_OV;
+	uint8_t vector = mem_read8(cpu, PC + 1);
+	uint16_t sp = cpu->sp + 4;
+	uint16_t ss = cpu->ss;
+	uint16_t flags;
+
+	cpu->ip += 2;
+	cpu->cycles += 2;
+	if (!service(cpu, vector))
+		return;
+	flags = mem_read16(cpu, ss, sp);
+	mem_write16(cpu, ss, sp, (flags & ~result) | (cpu->flags & result));
+}
+
+void bios_trap(X86Cpu *cpu, uint8_t vector, int on)
+{
+	if (on)
+		cpu->hle[vector >> 5] |= 1u << (vector & 31);
+	else
+		cpu->hle[vector >> 5] &= ~(1u << (vector & 31));
+}
+
+/* What POST leaves behind, for a program started without booting: the
+ * equipment and memory words, an empty keyboard buffer, the text mode, a
+ * programmed PIC and a running keyboard.  Vectors that go to a bare IRET
+ * never acknowledge an interrupt, so the PIC is set to auto-EOI. */
+void bios_post_data(X86Cpu *cpu)
+{
+	int mda = cpu->video.adapter == VIDEO_MDA;
+
+	set_bda16(cpu, BDA_EQUIPMENT, mda ? 0x003C : 0x002C);
+	set_bda16(cpu, BDA_MEM_SIZE, 640);
+	set_bda16(cpu, BDA_KBD_HEAD, BDA_KBD_BUF - BIOS_DATA);
+	set_bda16(cpu, BDA_KBD_TAIL, BDA_KBD_BUF - BIOS_DATA);
+	set_mode(cpu, mda ? 7 : 3);
+
+	io_write8(cpu, PIC_PORT, 0x13);		//ICW1: edge, single, ICW4
+	io_write8(cpu, PIC_PORT + 1, 0x08);	//ICW2: IRQ0 is INT 8h
+	io_write8(cpu, PIC_PORT + 1, 0x0B);	//ICW4: 8086, buffered, AEOI
+	io_write8(cpu, PIC_PORT + 1, 0xFC);	//timer and keyboard only
+	//let the keyboard clock run, without the reset an edge would cause
+	cpu->ppi.port_b = (cpu->ppi.port_b | PPI_B_KBD_CLK) & ~PPI_B_KBD_CLEAR;
+}
+
+//keyboard interrupt, video, disk, keyboard and time of day
+void bios_hle_enable(X86Cpu *cpu, int on)
+{
+	bios_trap(cpu, 0x09, on);
+	bios_trap(cpu, 0x10, on);
+	bios_trap(cpu, 0x13, on);
+	bios_trap(cpu, 0x16, on);
+	bios_trap(cpu, 0x1A, on);
+}
@@ -0,0 +1,38 @@
+#ifndef BIOS_H
+#define BIOS_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include "intel8086.h"
+
+/* High level emulation of the ROM BIOS.  A trapped vector is serviced in C
+ * the moment the interrupt is taken, instead of running the ROM's handler,
+ * as long as the vector still points into ROM; once the guest hooks it
+ * the guest's code runs as usual.  State lives where the ROM keeps it, in
+ * the BIOS data area and the devices, so HLE and ROM calls can be mixed
+ * freely.  Functions that are not implemented fall through to the ROM.
+ * A vector can also get a stub of BIOS_TRAP_OP vv, IRET placed where it
+ * points, which services it in C however the stub is reached. */
+#define BIOS_DATA 0x400
+#define BIOS_ROM_SEG 0xC000	//handlers in option ROMs count as the BIOS's
+#define BIOS_TRAP_OP 0xF1	//undocumented LOCK alias, no 8086 code uses it
+
+int bios_hle(X86Cpu *cpu, uint8_t vector);
+void bios_trap_op(X86Cpu *cpu);
+void bios_trap(X86Cpu *cpu, uint8_t vector, int on);
+void bios_hle_enable(X86Cpu *cpu, int on);
+void bios_post_data(X86Cpu *cpu);
+
+#endif
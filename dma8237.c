@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intel8086.h"
+#include "dma8237.h"
+#include "mem.h"
+#include "io.h"
+#include "sched.h"
+
+/* Intel 8237A DMA controller.  Transfers are not paced per byte: a device
+ * hands over a whole buffer and as much of it as the channel's count allows
+ * is copied in one go, straight through cpu->ram when the target is plain
+ * RAM in a single 64K page, otherwise a byte at a time through the memory
+ * map.  DRAM refresh on channel 0 only costs time, the cycles it steals are
+ * added to the cpu in one lump every DMA_REFRESH_BATCH cycles. */
+
+//page registers 81h-83h belong to channels 2, 3 and 1
+static const uint8_t page_ch[3] = { 2, 3, 1 };
+
+static void dma_tc(X86Cpu *cpu, int ch)
+{
+	DmaChannel *c = &cpu->dma.ch[ch];
+
+	cpu->dma.status |= 1 << ch;
+	if (c->mode & DMA_MODE_AUTO)
+	{
+		c->addr = c->base_addr;
+		c->count = c->base_count;
+	}
+	else
+		cpu->dma.mask |= 1 << ch;
+}
+
+static uint32_t dma_transfer(X86Cpu *cpu, int ch, uint8_t *buf, uint32_t len,
+	int write)
+{
+	DmaChannel *c = &cpu->dma.ch[ch];
+	int verify = (c->mode & 0x0C) == DMA_MODE_VERIFY;
+	int step = c->mode & DMA_MODE_DEC ? -1 : 1;
+	uint32_t done = 0, left, n, i, addr;
+
+	//command bit 2 disables the whole controller
+	if (cpu->dma.command & 0x04)
+		return 0;
+	while (done < len && !(cpu->dma.mask & 1 << ch))
+	{
+		left = (uint32_t)c->count + 1;
+		n = len - done < left ? len - done : left;
+		addr = c->page << 16 | c->addr;
+
+		if (verify)
+			c->addr += n * step;
+		else if (step > 0 && c->addr + n <= 0x10000
+			&& mem_range_is(cpu, addr, n, write))
+		{
+			if (write)
+			{
+				memcpy(&cpu->ram[addr], buf + done, n);
+				mem_dirty(cpu, addr, n);
+			}
+			else
+				memcpy(buf + done, &cpu->ram[addr], n);
+			c->addr += n;
+		}
+		else
+		{
+			//the address wraps inside its 64K page
+			for (i = 0; i < n; i++, c->addr += step)
+			{
+				addr = c->page << 16 | c->addr;
+				if (write)
+					mem_write8(cpu, addr, buf[done + i]);
+				else
+					buf[done + i] = mem_read8(cpu, addr);
+			}
+		}
+		done += n;
+		c->count -= n;
+		if (n == left)
+			dma_tc(cpu, ch);
+	}
+	return done;
+}
+
+/* Device to memory, for a disk read.  Returns the bytes taken, fewer than
+ * len if the channel reached terminal count or is masked. */
+uint32_t dma_write_mem(X86Cpu *cpu, int ch, const uint8_t *src, uint32_t len)
+{
+	return dma_transfer(cpu, ch, (uint8_t *)src, len, 1);
+}
+
+//memory to device, for a disk write
+uint32_t dma_read_mem(X86Cpu *cpu, int ch, uint8_t *dst, uint32_t len)
+{
+	return dma_transfer(cpu, ch, dst, len, 0);
+}
+
+/* PIT channel 1 requests a refresh cycle on DMA channel 0 every period;
+ * charge the cpu for the ones since the last batch. */
+static void dma_refresh(X86Cpu *cpu)
+{
+	PitChannel *t = &cpu->pit.ch[1];
+	uint64_t period, n;
+
+	if (!(cpu->dma.mask & 1 << DMA_REFRESH_CH) && t->armed
+		&& (t->mode == 2 || t->mode == 3))
+	{
+		period = (uint64_t)t->count * PIT_DIVISOR;
+		n = (cpu->cycles - cpu->dma.refresh_mark) / period;
+		cpu->dma.refresh_mark += n * period;
+		cpu->cycles += n * DMA_REFRESH_CYCLES;
+	}
+	else
+		cpu->dma.refresh_mark = cpu->cycles;
+	sched_at(cpu, SCHED_DMA_REFRESH, cpu->cycles + DMA_REFRESH_BATCH);
+}
+
+uint8_t dma_read(X86Cpu *cpu, uint16_t port)
+{
+	Dma8237 *dma = &cpu->dma;
+	DmaChannel *c;
+	uint16_t val;
+	uint8_t ret;
+
+	if (port >= DMA_PAGE_PORT)
+		return dma->ch[page_ch[port - DMA_PAGE_PORT - 1]].page;
+	port &= 0x0F;
+	if (port < 8)
+	{
+		c = &dma->ch[port >> 1];
+		val = port & 1 ? c->count : c->addr;
+		ret = dma->flipflop ? val >> 8 : val & 0xFF;
+		dma->flipflop ^= 1;
+		return ret;
+	}
+	switch (port)
+	{
+		case 0x08:
+			//reading status clears the terminal count bits
+			ret = dma->status | dma->request << 4;
+			dma->status &= 0xF0;
+			return ret;
+		case 0x0D:
+			return dma->temp;
+		default:
+			return 0xFF;
+	}
+}
+
+void dma_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	Dma8237 *dma = &cpu->dma;
+	DmaChannel *c;
+	uint16_t *reg, *base;
+
+	if (port >= DMA_PAGE_PORT)
+	{
+		dma->ch[page_ch[port - DMA_PAGE_PORT - 1]].page = val & 0x0F;
+		return;
+	}
+	port &= 0x0F;
+	if (port < 8)
+	{
+		c = &dma->ch[port >> 1];
+		reg = port & 1 ? &c->count : &c->addr;
+		base = port & 1 ? &c->base_count : &c->base_addr;
+		if (dma->flipflop)
+			*reg = (*reg & 0x00FF) | val << 8;
+		else
+			*reg = (*reg & 0xFF00) | val;
+		*base = *reg;
+		dma->flipflop ^= 1;
+		return;
+	}
+	switch (port)
+	{
+		case 0x08:
+			dma->command = val;
+			break;
+		case 0x09:
+			if (val & 0x04)
+				dma->request |= 1 << (val & 3);
+			else
+				dma->request &= ~(1 << (val & 3));
+			break;
+		case 0x0A:
+			if (val & 0x04)
+				dma->mask |= 1 << (val & 3);
+			else
+				dma->mask &= ~(1 << (val & 3));
+			break;
+		case 0x0B:
+			dma->ch[val & 3].mode = val & 0xFC;
+			break;
+		case 0x0C:
+			dma->flipflop = 0;
+			break;
+		case 0x0D:
+			//master clear
+			dma->command = 0;
+			dma->status = 0;
+			dma->request = 0;
+			dma->temp = 0;
+			dma->flipflop = 0;
+			dma->mask = 0x0F;
+			break;
+		case 0x0E:
+			dma->mask = 0;
+			break;
+		case 0x0F:
+			dma->mask = val & 0x0F;
+			break;
+	}
+}
+
+static const IoHandler dma_ports = { dma_read, dma_write, NULL, NULL };
+
+void dma_init(X86Cpu *cpu)
+{
+	memset(&cpu->dma, 0, sizeof(Dma8237));
+	cpu->dma.mask = 0x0F;
+	cpu->dma.refresh_mark = cpu->cycles;
+	io_register(cpu, DMA_PORT, 16, &dma_ports);
+	io_register(cpu, DMA_PAGE_PORT + 1, 3, &dma_ports);
+	sched_register(cpu, SCHED_DMA_REFRESH, dma_refresh);
+	sched_at(cpu, SCHED_DMA_REFRESH, cpu->cycles + DMA_REFRESH_BATCH);
+}
@@ -0,0 +1,61 @@
+#ifndef DMA8237_H
+#define DMA8237_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+struct X86Cpu;
+
+//ports 00h-0Fh, page registers at 80h-83h
+#define DMA_PORT 0x00
+#define DMA_PAGE_PORT 0x80
+
+//channel 0 refreshes DRAM each time PIT channel 1 fires
+#define DMA_REFRESH_CH 0
+#define DMA_REFRESH_CYCLES 4
+//how often the accumulated refresh time is charged to the cpu
+#define DMA_REFRESH_BATCH 65536
+
+//mode register
+#define DMA_MODE_VERIFY	0x00
+#define DMA_MODE_WRITE	0x04	//device to memory
+#define DMA_MODE_READ	0x08	//memory to device
+#define DMA_MODE_AUTO	0x10
+#define DMA_MODE_DEC	0x20
+
+typedef struct {
+	uint16_t base_addr, base_count;
+	uint16_t addr, count;		//count is transfers left minus one
+	uint8_t mode;
+	uint8_t page;
+} DmaChannel;
+
+typedef struct {
+	DmaChannel ch[4];
+	uint8_t command, status;
+	uint8_t mask, request;
+	uint8_t flipflop;		//next address/count byte is the high one
+	uint8_t temp;
+	uint64_t refresh_mark;		//cycle refresh was last charged up to
+} Dma8237;
+
+void dma_init(struct X86Cpu *cpu);
+uint8_t dma_read(struct X86Cpu *cpu, uint16_t port);
+void dma_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+uint32_t dma_write_mem(struct X86Cpu *cpu, int ch, const uint8_t *src,
+	uint32_t len);
+uint32_t dma_read_mem(struct X86Cpu *cpu, int ch, uint8_t *dst, uint32_t len);
+
+#endif
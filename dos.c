@@ -0,0 +1,1009 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <strings.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "opcode.h"
+#include "dos.h"
+#include "bios.h"
+
+#define PARA(seg) ((uint32_t)(seg) << 4)
+#define PSP_PARAS 0x10
+#define ENV_PARAS 4		//no variables, just the program's name
+#define TAIL_MAX 126
+#define BDA_MEM_SIZE 0x413	//conventional memory in K
+#define BDA_KBD_HEAD 0x41A	//0 until POST has run
+#define PATH_MAX_DOS 128
+
+//INT 21h error codes
+#define ERR_FUNCTION	0x01
+#define ERR_NO_FILE	0x02
+#define ERR_NO_PATH	0x03
+#define ERR_HANDLES	0x04
+#define ERR_DENIED	0x05
+#define ERR_HANDLE	0x06
+#define ERR_ARENA	0x07
+#define ERR_MEMORY	0x08
+#define ERR_BLOCK	0x09
+#define ERR_ACCESS	0x0C
+
+//MZ header, as word offsets
+enum {
+	MZ_MAGIC, MZ_LAST, MZ_PAGES, MZ_RELOCS, MZ_HEADER, MZ_MIN, MZ_MAX,
+	MZ_SS, MZ_SP, MZ_SUM, MZ_IP, MZ_CS, MZ_RELOC_AT, MZ_WORDS
+};
+
+int dos_init(X86Cpu *cpu)
+{
+	cpu->dos = calloc(1, sizeof(Dos));
+	if (cpu->dos == NULL)
+		return -1;
+	cpu->dos->exit_code = -1;
+	cpu->dos->con = stdout;
+	cpu->dos->in = stdin;
+	cpu->dos->ahead = EOF;
+	return 0;
+}
+
+//close the program's files and reopen the standard handles
+static void reset_handles(Dos *dos)
+{
+	int i;
+
+	for (i = DOS_FIRST_FILE; i < DOS_HANDLES; i++)
+	{
+		if (dos->file[i])
+			fclose(dos->file[i]);
+	}
+	memset(dos->file, 0, sizeof(dos->file));
+	memset(dos->writing, 0, sizeof(dos->writing));
+	dos->file[0] = dos->in;
+	dos->file[1] = dos->con;
+	dos->file[2] = stderr;
+}
+
+void dos_free(X86Cpu *cpu)
+{
+	if (cpu->dos == NULL)
+		return;
+	reset_handles(cpu->dos);
+	free(cpu->dos->root);
+	free(cpu->dos);
+	cpu->dos = NULL;
+}
+
+int dos_set_root(X86Cpu *cpu, const char *dir)
+{
+	struct stat st;
+	char *root = NULL;
+
+	if (dir && (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)))
+	{
+		fprintf(stderr, "no directory %s\n", dir);
+		return -1;
+	}
+	if (dir && (root = strdup(dir)) == NULL)
+		return -1;
+	free(cpu->dos->root);
+	cpu->dos->root = root;
+	return 0;
+}
+
+static uint16_t word(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static void set_word(uint8_t *p, uint16_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+//top of conventional memory as a segment, all 640K if POST never sized it
+static uint16_t mem_top(X86Cpu *cpu)
+{
+	uint16_t kb = word(&cpu->ram[BDA_MEM_SIZE]);
+
+	if (kb == 0 || kb > 640)
+		kb = 640;
+	return kb << 6;
+}
+
+static void set_mcb(X86Cpu *cpu, uint32_t seg, char type, uint16_t owner,
+	uint16_t paras)
+{
+	uint8_t *mcb = &cpu->ram[PARA(seg)];
+
+	memset(mcb, 0, 16);
+	mcb[0] = type;
+	set_word(&mcb[1], owner);
+	set_word(&mcb[3], paras);
+}
+
+/* A block of paras for owner at seg, whatever is left over up to top
+ * becomes a free block closing the chain. */
+static void alloc_block(X86Cpu *cpu, uint16_t seg, uint16_t owner,
+	uint16_t paras, uint16_t top)
+{
+	if (top - seg - 1 > paras)
+	{
+		set_mcb(cpu, seg, 'M', owner, paras);
+		set_mcb(cpu, seg + 1 + paras, 'Z', 0, top - seg - 2 - paras);
+	}
+	else
+		set_mcb(cpu, seg, 'Z', owner, top - seg - 1);
+}
+
+//an empty environment followed by the program's name, as DOS 3 leaves it
+static void make_env(X86Cpu *cpu, uint16_t env, const char *filename)
+{
+	uint8_t *p = &cpu->ram[PARA(env)];
+	const char *name = strrchr(filename, '/');
+	int i;
+
+	name = name ? name + 1 : filename;
+	memset(p, 0, ENV_PARAS * 16);
+	set_word(&p[2], 1);
+	memcpy(&p[4], "C:\\", 3);
+	for (i = 0; name[i] && i < 12; i++)
+		p[7 + i] = toupper((unsigned char)name[i]);
+}
+
+static void make_psp(X86Cpu *cpu, uint16_t psp, uint16_t env, uint16_t top,
+	const char *args)
+{
+	uint8_t *p = &cpu->ram[PARA(psp)];
+	size_t len = args ? strlen(args) : 0;
+
+	memset(p, 0, 256);
+	p[0x00] = 0xCD;			//INT 20h
+	p[0x01] = 0x20;
+	set_word(&p[0x02], top);
+	//terminate, break and critical error addresses
+	memcpy(&p[0x0A], &cpu->ram[0x22 * 4], 12);
+	set_word(&p[0x16], psp);	//its own parent, like COMMAND.COM
+	memset(&p[0x18], 0xFF, 20);	//handles 0-4 open on CON, AUX, PRN
+	memcpy(&p[0x18], "\x01\x01\x01\x00\x02", 5);
+	set_word(&p[0x2C], env);
+	set_word(&p[0x32], 20);
+	set_word(&p[0x34], 0x18);
+	set_word(&p[0x36], psp);
+	memcpy(&p[0x50], "\xCD\x21\xCB", 3);	//INT 21h, RETF
+	memset(&p[0x5D], ' ', 11);	//two empty FCBs
+	memset(&p[0x6D], ' ', 11);
+	if (len > TAIL_MAX - 1)
+		len = TAIL_MAX - 1;
+	if (len)
+	{
+		p[0x81] = ' ';
+		memcpy(&p[0x82], args, len++);
+	}
+	p[0x80] = len;
+	p[0x81 + len] = '\r';
+}
+
+/* Nothing has set up the vector table if the BIOS never ran, so every empty
+ * vector goes to the stub and returns at once.  INT 20h and 21h get trap
+ * stubs of their own in blank ROM space: entered through interrupt() they
+ * are serviced before anything is pushed, and a TSR or runtime that hooks
+ * them and chains on to the saved address still reaches DOS. */
+static void stub_vectors(X86Cpu *cpu)
+{
+	uint32_t stub;
+	int i;
+
+	cpu->ram[DOS_STUB] = 0xCF;
+	for (i = 0; i < 256; i++)
+	{
+		if (i == 0x20 || i == 0x21)
+		{
+			stub = DOS_TRAP + (i - 0x20) * 4;
+			cpu->ram[stub] = BIOS_TRAP_OP;
+			cpu->ram[stub + 1] = i;
+			cpu->ram[stub + 2] = 0xCF;
+		}
+		else if ((word(&cpu->ram[i * 4]) | word(&cpu->ram[i * 4 + 2])) != 0)
+			continue;
+		else
+			stub = DOS_STUB;
+		set_word(&cpu->ram[i * 4], stub & 0xFFFF);
+		set_word(&cpu->ram[i * 4 + 2], (stub >> 4) & 0xF000);
+	}
+	bios_trap(cpu, 0x20, 1);
+	bios_trap(cpu, 0x21, 1);
+}
+
+static int load_com(X86Cpu *cpu, uint16_t psp, uint16_t top,
+	const uint8_t *buf, size_t size)
+{
+	if (size > DOS_COM_MAX - 0x100 || top - psp < 0x1000)
+		return -1;
+	alloc_block(cpu, psp - 1, psp, top - psp, top);
+	memcpy(&cpu->ram[PARA(psp) + 0x100], buf, size);
+	cpu->cs = cpu->ds = cpu->es = cpu->ss = psp;
+	cpu->ip = 0x100;
+	//a RET from the top level lands on the INT 20h at PSP:0000
+	cpu->sp = 0xFFFE;
+	set_word(&cpu->ram[PARA(psp) + cpu->sp], 0);
+	return 0;
+}
+
+static int load_exe(X86Cpu *cpu, uint16_t psp, uint16_t top,
+	const uint8_t *buf, size_t size)
+{
+	uint16_t h[MZ_WORDS];
+	uint16_t start = psp + PSP_PARAS;
+	uint32_t hdr, image, need, paras, addr;
+	const uint8_t *rel;
+	int i;
+
+	if (size < MZ_WORDS * 2)
+		return -1;
+	for (i = 0; i < MZ_WORDS; i++)
+		h[i] = word(&buf[i * 2]);
+	hdr = h[MZ_HEADER] * 16;
+	image = h[MZ_PAGES] * 512;
+	if (h[MZ_LAST])
+		image -= 512 - h[MZ_LAST];
+	if (hdr > size || image < hdr
+		|| h[MZ_RELOC_AT] + h[MZ_RELOCS] * 4 > size)
+		return -1;
+	//linkers round up the last page, trust the file size over the header
+	image -= hdr;
+	if (image > size - hdr)
+		image = size - hdr;
+	need = PSP_PARAS + (image + 15) / 16;
+	if (psp + need + h[MZ_MIN] > top)
+		return -1;
+	paras = need + h[MZ_MAX];
+	if (paras > (uint32_t)(top - psp))
+		paras = top - psp;
+	alloc_block(cpu, psp - 1, psp, paras, top);
+	memcpy(&cpu->ram[PARA(start)], buf + hdr, image);
+	rel = buf + h[MZ_RELOC_AT];
+	for (i = 0; i < h[MZ_RELOCS]; i++, rel += 4)
+	{
+		addr = (PARA(start + word(rel + 2)) + word(rel)) & 0xFFFFF;
+		if (addr + 1 < RAM_SIZE)
+			set_word(&cpu->ram[addr], word(&cpu->ram[addr]) + start);
+	}
+	cpu->cs = start + h[MZ_CS];
+	cpu->ip = h[MZ_IP];
+	cpu->ss = start + h[MZ_SS];
+	cpu->sp = h[MZ_SP];
+	cpu->ds = cpu->es = psp;
+	return 0;
+}
+
+/* Load a program as if COMMAND.COM had run it with args as the command
+ * tail: the environment and the program each get a block in the arena,
+ * the program as much memory as it asks for, all of it for a .COM. */
+int dos_load(X86Cpu *cpu, const char *filename, const char *args)
+{
+	uint16_t env = DOS_FREE_SEG + 1;
+	uint16_t psp = env + ENV_PARAS + 1;
+	uint16_t top = mem_top(cpu);
+	uint8_t *buf;
+	long size;
+	FILE *fp;
+	int ret;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "program %s not found!\n", filename);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+	buf = malloc(size > 0 ? size : 1);
+	if (buf == NULL || fread(buf, 1, size, fp) != (size_t)size)
+	{
+		free(buf);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	if (word(&cpu->ram[BDA_KBD_HEAD]) == 0)
+		bios_post_data(cpu);
+	stub_vectors(cpu);
+	alloc_block(cpu, DOS_FREE_SEG, psp, ENV_PARAS, top);
+	make_env(cpu, env, filename);
+	make_psp(cpu, psp, env, top, args);
+	if (size >= 2 && (memcmp(buf, "MZ", 2) == 0 || memcmp(buf, "ZM", 2) == 0))
+		ret = load_exe(cpu, psp, top, buf, size);
+	else
+		ret = load_com(cpu, psp, top, buf, size);
+	free(buf);
+	if (ret != 0)
+	{
+		fprintf(stderr, "can't load %s, bad header or too big\n", filename);
+		return -1;
+	}
+	//AL and AH report whether the FCB drives are valid
+	cpu->ax.w = 0;
+	cpu->flags = FLAGS_INT;
+	intr_sync(cpu);
+	cpu->dos->psp = psp;
+	cpu->dos->exit_code = -1;
+	reset_handles(cpu->dos);
+	return 0;
+}
+
+/* The program is gone, the cpu sits on the INT 20h at PSP:0000 and halts
+ * there again if run on, keeping the first exit code. */
+static void terminate(X86Cpu *cpu, uint8_t code)
+{
+	Dos *dos = cpu->dos;
+
+	reset_handles(dos);
+	fflush(dos->con);
+	if (dos->exit_code < 0)
+		dos->exit_code = code;
+	cpu->cs = dos->psp;
+	cpu->ip = 0;
+	cpu->running = 0;
+}
+
+/* Console input bypasses stdio, whose buffer poll could not see into, and
+ * goes a byte at a time to the descriptor.  EOF once input runs out. */
+static int con_byte(Dos *dos)
+{
+	uint8_t ch;
+	ssize_t n;
+
+	do
+		n = read(fileno(dos->in), &ch, 1);
+	while (n < 0 && errno == EINTR);
+	return n == 1 ? ch : EOF;
+}
+
+static int con_getc(Dos *dos)
+{
+	int ch = dos->ahead;
+
+	fflush(dos->con);
+	if (ch == EOF)
+		ch = con_byte(dos);
+	dos->ahead = EOF;
+	return ch == EOF ? 0x1A : ch;	//^Z once input runs out
+}
+
+/* Whether a key can be had without waiting.  A byte is read ahead to tell
+ * a key from the end of input, which is not one. */
+static int con_ready(Dos *dos)
+{
+	struct pollfd pfd = { fileno(dos->in), POLLIN, 0 };
+
+	fflush(dos->con);
+	if (dos->ahead == EOF && poll(&pfd, 1, 0) > 0)
+		dos->ahead = con_byte(dos);
+	return dos->ahead != EOF;
+}
+
+//a key as DOS sees it, Enter is a carriage return
+static uint8_t con_key(Dos *dos, int echo)
+{
+	int ch = con_getc(dos);
+
+	if (echo && ch != 0x1A)
+		fputc(ch, dos->con);
+	return ch == '\n' ? '\r' : ch;
+}
+
+//AH=0Ah, a line into the buffer at DS:DX, which holds its size first
+static void read_line(X86Cpu *cpu)
+{
+	Dos *dos = cpu->dos;
+	uint32_t buf = PARA(cpu->ds) + cpu->dx.w;
+	uint8_t max = mem_read8(cpu, buf);
+	int n = 0, ch;
+
+	if (max == 0)
+		return;
+	while ((ch = con_getc(dos)) != '\n' && ch != 0x1A)
+	{
+		if (n + 1 < max && ch != '\r')
+		{
+			fputc(ch, dos->con);
+			mem_write8(cpu, buf + 2 + n++, ch);
+		}
+	}
+	fputc('\n', dos->con);
+	mem_write8(cpu, buf + 2 + n, '\r');
+	mem_write8(cpu, buf + 1, n);
+}
+
+//reading the console handle gets a line at a time, ending in CR LF
+static uint16_t con_read(X86Cpu *cpu, uint32_t addr, uint16_t len)
+{
+	uint16_t n = 0;
+	int ch;
+
+	while (n < len && (ch = con_getc(cpu->dos)) != 0x1A)
+	{
+		if (ch == '\n')
+		{
+			mem_write8(cpu, addr + n++, '\r');
+			if (n < len)
+				mem_write8(cpu, addr + n++, '\n');
+			break;
+		}
+		mem_write8(cpu, addr + n++, ch);
+	}
+	return n;
+}
+
+/* Map the ASCIIZ name at DS:DX to a host path under the root.  The drive
+ * is dropped and ".." refused, so nothing above the root can be named, and
+ * each part matches an existing host name whatever its case, as on DOS. */
+static int host_path(X86Cpu *cpu, char *path, size_t size)
+{
+	Dos *dos = cpu->dos;
+	char name[PATH_MAX_DOS], *part, *save;
+	struct dirent *de;
+	const char *match;
+	size_t len;
+	DIR *dir;
+	int i;
+
+	if (dos->root == NULL)
+		return ERR_DENIED;
+	for (i = 0; i < PATH_MAX_DOS - 1; i++)
+	{
+		name[i] = mem_read8(cpu, PARA(cpu->ds) + (uint16_t)(cpu->dx.w + i));
+		if (name[i] == '\\')
+			name[i] = '/';
+		if (name[i] == 0)
+			break;
+	}
+	name[i] = 0;
+	part = name;
+	if (isalpha((unsigned char)part[0]) && part[1] == ':')
+		part += 2;
+	if ((size_t)snprintf(path, size, "%s", dos->root) >= size)
+		return ERR_NO_PATH;
+	for (part = strtok_r(part, "/", &save); part; part = strtok_r(NULL, "/", &save))
+	{
+		if (strcmp(part, ".") == 0)
+			continue;
+		if (strcmp(part, "..") == 0)
+			return ERR_NO_PATH;
+		len = strlen(path);
+		match = part;
+		dir = opendir(path);
+		while (dir && (de = readdir(dir)) != NULL)
+		{
+			if (strcasecmp(de->d_name, part) == 0)
+			{
+				match = de->d_name;
+				break;
+			}
+		}
+		i = snprintf(path + len, size - len, "/%s", match);
+		if (dir)
+			closedir(dir);
+		if ((size_t)i >= size - len)
+			return ERR_NO_PATH;
+	}
+	return 0;
+}
+
+static int host_error(void)
+{
+	switch (errno)
+	{
+		case ENOENT:
+			return ERR_NO_FILE;
+		case ENOTDIR:
+			return ERR_NO_PATH;
+		case EMFILE:
+		case ENFILE:
+			return ERR_HANDLES;
+		default:
+			return ERR_DENIED;
+	}
+}
+
+//AH=3Ch and 3Dh, the new handle in AX
+static int handle_open(X86Cpu *cpu, const char *mode)
+{
+	Dos *dos = cpu->dos;
+	char path[1024];
+	struct stat st;
+	FILE *fp;
+	int h, err;
+
+	for (h = DOS_FIRST_FILE; h < DOS_HANDLES && dos->file[h]; h++)
+		;
+	if (h == DOS_HANDLES)
+		return ERR_HANDLES;
+	err = host_path(cpu, path, sizeof(path));
+	if (err)
+		return err;
+	fp = fopen(path, mode);
+	if (fp == NULL)
+		return host_error();
+	if (fstat(fileno(fp), &st) != 0 || S_ISDIR(st.st_mode))
+	{
+		fclose(fp);
+		return ERR_DENIED;
+	}
+	dos->file[h] = fp;
+	dos->writing[h] = 0;
+	cpu->ax.w = h;
+	return 0;
+}
+
+//the stream behind BX, NULL for AUX and PRN which go nowhere
+static int handle(X86Cpu *cpu, FILE **fp)
+{
+	Dos *dos = cpu->dos;
+	uint16_t h = cpu->bx.w;
+
+	if (h >= DOS_HANDLES || (h >= DOS_FIRST_FILE && dos->file[h] == NULL))
+		return ERR_HANDLE;
+	*fp = dos->file[h];
+	return 0;
+}
+
+/* A host stream to guest RAM or back.  Plain RAM is handed straight to
+ * stdio so the data is copied once, from its buffer or the page cache;
+ * anything else, or a transfer off the top of memory, goes bytewise. */
+static uint16_t transfer(X86Cpu *cpu, FILE *fp, int write, uint32_t addr,
+	uint16_t len)
+{
+	size_t done;
+	int ch, i;
+
+	if (mem_range_is(cpu, addr, len, !write))
+	{
+		if (write)
+			return fwrite(&cpu->ram[addr], 1, len, fp);
+		done = fread(&cpu->ram[addr], 1, len, fp);
+		mem_dirty(cpu, addr, done);
+		return done;
+	}
+	for (i = 0; i < len; i++)
+	{
+		if (write && fputc(mem_read8(cpu, addr + i), fp) == EOF)
+			break;
+		if (!write && (ch = fgetc(fp)) == EOF)
+			break;
+		if (!write)
+			mem_write8(cpu, addr + i, ch);
+	}
+	return i;
+}
+
+//AH=3Fh and 40h, CX bytes at DS:DX, the count done in AX
+static int handle_rw(X86Cpu *cpu, int write)
+{
+	Dos *dos = cpu->dos;
+	uint16_t h = cpu->bx.w;
+	uint32_t addr = PARA(cpu->ds) + cpu->dx.w;
+	FILE *fp;
+	int err;
+
+	err = handle(cpu, &fp);
+	if (err)
+		return err;
+	if (fp == NULL)
+	{
+		cpu->ax.w = write ? cpu->cx.w : 0;
+		return 0;
+	}
+	if (h >= DOS_FIRST_FILE && dos->writing[h] != write)
+	{
+		fseek(fp, 0, SEEK_CUR);
+		dos->writing[h] = write;
+	}
+	if (!write && fp == dos->in)
+		cpu->ax.w = con_read(cpu, addr, cpu->cx.w);
+	else if (write && cpu->cx.w == 0 && h >= DOS_FIRST_FILE)
+	{
+		//a write of nothing cuts the file off where it stands
+		fflush(fp);
+		if (ftruncate(fileno(fp), ftell(fp)) != 0)
+			return ERR_DENIED;
+		cpu->ax.w = 0;
+	}
+	else
+	{
+		cpu->ax.w = transfer(cpu, fp, write, addr, cpu->cx.w);
+		if (cpu->ax.w == 0 && ferror(fp))
+		{
+			clearerr(fp);
+			return ERR_DENIED;
+		}
+	}
+	return 0;
+}
+
+static int handle_close(X86Cpu *cpu)
+{
+	Dos *dos = cpu->dos;
+	FILE *fp;
+	int err;
+
+	err = handle(cpu, &fp);
+	if (err)
+		return err;
+	//the console and friends stay open for whoever comes next
+	if (cpu->bx.w >= DOS_FIRST_FILE)
+	{
+		fclose(fp);
+		dos->file[cpu->bx.w] = NULL;
+	}
+	return 0;
+}
+
+//AH=42h, AL is the origin and CX:DX the offset, the new position in DX:AX
+static int handle_seek(X86Cpu *cpu)
+{
+	static const int whence[3] = { SEEK_SET, SEEK_CUR, SEEK_END };
+	int32_t off = (int32_t)((uint32_t)cpu->cx.w << 16 | cpu->dx.w);
+	FILE *fp;
+	long pos = 0;
+	int err;
+
+	err = handle(cpu, &fp);
+	if (err)
+		return err;
+	if (cpu->ax.l > 2)
+		return ERR_FUNCTION;
+	if (cpu->bx.w >= DOS_FIRST_FILE)
+	{
+		if (fseek(fp, off, whence[cpu->ax.l]) != 0)
+			return ERR_FUNCTION;
+		pos = ftell(fp);
+	}
+	cpu->ax.w = pos;
+	cpu->dx.w = pos >> 16;
+	return 0;
+}
+
+//AH=44h, only enough for a C runtime to tell devices from files
+static int handle_info(X86Cpu *cpu)
+{
+	FILE *fp;
+	int err;
+
+	err = handle(cpu, &fp);
+	if (err)
+		return err;
+	switch (cpu->ax.l)
+	{
+		case 0x00:
+			if (cpu->bx.w >= DOS_FIRST_FILE)
+				cpu->dx.w = 0x0002;	//a file on C:
+			else if (fp == NULL)
+				cpu->dx.w = 0x80C0;	//some other device
+			else
+				cpu->dx.w = 0x80D3;	//the console
+			return 0;
+		case 0x01:
+			return 0;
+		default:
+			return ERR_FUNCTION;
+	}
+}
+
+static int file_delete(X86Cpu *cpu)
+{
+	char path[1024];
+	int err;
+
+	err = host_path(cpu, path, sizeof(path));
+	if (err)
+		return err;
+	return unlink(path) == 0 ? 0 : host_error();
+}
+
+/* The MCB after the block at seg, 0 if the block runs past the top of the
+ * arena, which a guest that wrote over the chain can make it do. */
+static uint32_t next_mcb(X86Cpu *cpu, uint32_t seg)
+{
+	uint32_t next = seg + 1 + word(&cpu->ram[PARA(seg) + 3]);
+
+	return next <= mem_top(cpu) ? next : 0;
+}
+
+/* Walk the arena from the first MCB to the one at seg, 0 if it is found,
+ * otherwise whether the chain is broken or seg is not in it. */
+static int find_block(X86Cpu *cpu, uint16_t seg)
+{
+	uint32_t at = DOS_FREE_SEG;
+	uint8_t *m;
+
+	while (at < mem_top(cpu))
+	{
+		m = &cpu->ram[PARA(at)];
+		if (m[0] != 'M' && m[0] != 'Z')
+			return ERR_ARENA;
+		if (at == seg)
+			return 0;
+		if (m[0] == 'Z')
+			return ERR_BLOCK;
+		at = next_mcb(cpu, at);
+		if (at == 0)
+			return ERR_ARENA;
+	}
+	return ERR_ARENA;
+}
+
+//grow the block at seg over any free ones right after it
+static int merge_free(X86Cpu *cpu, uint16_t seg)
+{
+	uint8_t *m = &cpu->ram[PARA(seg)];
+	uint8_t *next;
+	uint32_t at;
+
+	while (m[0] == 'M')
+	{
+		at = next_mcb(cpu, seg);
+		if (at == 0 || at >= mem_top(cpu))
+			return ERR_ARENA;
+		next = &cpu->ram[PARA(at)];
+		if ((next[0] != 'M' && next[0] != 'Z') || word(&next[1]) != 0)
+			break;
+		if (next_mcb(cpu, at) == 0)
+			return ERR_ARENA;
+		m[0] = next[0];
+		set_word(&m[3], word(&m[3]) + 1 + word(&next[3]));
+	}
+	return next_mcb(cpu, seg) == 0 ? ERR_ARENA : 0;
+}
+
+//cut the block at seg down to paras, the rest becomes a free block
+static int split_block(X86Cpu *cpu, uint16_t seg, uint16_t paras)
+{
+	uint8_t *m = &cpu->ram[PARA(seg)];
+	uint16_t size = word(&m[3]);
+
+	if (next_mcb(cpu, seg) == 0)
+		return ERR_ARENA;
+	if (size <= paras)
+		return 0;
+	set_mcb(cpu, (uint32_t)seg + 1 + paras, m[0], 0, size - paras - 1);
+	m[0] = 'M';
+	set_word(&m[3], paras);
+	return 0;
+}
+
+//AH=48h, first fit for BX paragraphs, the segment in AX
+static int mem_alloc(X86Cpu *cpu)
+{
+	uint32_t seg = DOS_FREE_SEG;
+	uint16_t largest = 0;
+	uint8_t *m;
+	int err;
+
+	for (;;)
+	{
+		m = &cpu->ram[PARA(seg)];
+		if (m[0] != 'M' && m[0] != 'Z')
+			return ERR_ARENA;
+		if (word(&m[1]) == 0)
+		{
+			err = merge_free(cpu, seg);
+			if (err)
+				return err;
+			if (word(&m[3]) >= cpu->bx.w)
+			{
+				err = split_block(cpu, seg, cpu->bx.w);
+				if (err)
+					return err;
+				set_word(&m[1], cpu->dos->psp);
+				cpu->ax.w = seg + 1;
+				return 0;
+			}
+			if (word(&m[3]) > largest)
+				largest = word(&m[3]);
+		}
+		if (m[0] == 'Z')
+			break;
+		seg = next_mcb(cpu, seg);
+		if (seg == 0 || seg >= mem_top(cpu))
+			return ERR_ARENA;
+	}
+	cpu->bx.w = largest;
+	return ERR_MEMORY;
+}
+
+//AH=49h, the block at ES
+static int mem_release(X86Cpu *cpu)
+{
+	uint16_t seg = cpu->es - 1;
+	int err;
+
+	err = find_block(cpu, seg);
+	if (err)
+		return err;
+	set_word(&cpu->ram[PARA(seg) + 1], 0);
+	return 0;
+}
+
+//AH=4Ah, the block at ES to BX paragraphs, or BX says what would fit
+static int mem_resize(X86Cpu *cpu)
+{
+	uint16_t seg = cpu->es - 1;
+	uint16_t size, max;
+	int err;
+
+	err = find_block(cpu, seg);
+	if (err)
+		return err;
+	size = word(&cpu->ram[PARA(seg) + 3]);
+	err = merge_free(cpu, seg);
+	if (err)
+		return err;
+	max = word(&cpu->ram[PARA(seg) + 3]);
+	if (cpu->bx.w > max)
+	{
+		split_block(cpu, seg, size);
+		cpu->bx.w = max;
+		return ERR_MEMORY;
+	}
+	return split_block(cpu, seg, cpu->bx.w);
+}
+
+static int int21(X86Cpu *cpu)
+{
+	static const char *const modes[3] = { "rb", "r+b", "r+b" };
+	Dos *dos = cpu->dos;
+	uint32_t addr, i;
+	uint8_t ch;
+	int err = 0;
+
+	clear_flag(cpu, FLAGS_CF);
+	switch (cpu->ax.h)
+	{
+		case 0x00:
+			terminate(cpu, 0);
+			break;
+		case 0x01:
+			cpu->ax.l = con_key(dos, 1);
+			break;
+		case 0x02:
+			fputc(cpu->dx.l, dos->con);
+			cpu->ax.l = cpu->dx.l;
+			break;
+		case 0x06:
+			if (cpu->dx.l != 0xFF)
+			{
+				fputc(cpu->dx.l, dos->con);
+				cpu->ax.l = cpu->dx.l;
+				break;
+			}
+			if (!con_ready(dos))
+			{
+				cpu->ax.l = 0;
+				set_flag(cpu, FLAGS_ZF);
+				break;
+			}
+			cpu->ax.l = con_key(dos, 0);
+			clear_flag(cpu, FLAGS_ZF);
+			break;
+		case 0x07:
+		case 0x08:
+			cpu->ax.l = con_key(dos, 0);
+			break;
+		case 0x09:
+			addr = PARA(cpu->ds);
+			for (i = 0; i < 0x10000; i++)
+			{
+				ch = mem_read8(cpu, addr + (uint16_t)(cpu->dx.w + i));
+				if (ch == '$')
+					break;
+				fputc(ch, dos->con);
+			}
+			cpu->ax.l = '$';
+			break;
+		case 0x0A:
+			read_line(cpu);
+			break;
+		case 0x0B:
+			cpu->ax.l = con_ready(dos) ? 0xFF : 0x00;
+			break;
+		case 0x25:
+			mem_write16(cpu, 0, cpu->ax.l * 4, cpu->dx.w);
+			mem_write16(cpu, 0, cpu->ax.l * 4 + 2, cpu->ds);
+			break;
+		case 0x30:
+			cpu->ax.w = 0x1E03;	//3.30
+			cpu->bx.w = cpu->cx.w = 0;
+			break;
+		case 0x35:
+			cpu->bx.w = mem_read16(cpu, 0, cpu->ax.l * 4);
+			cpu->es = mem_read16(cpu, 0, cpu->ax.l * 4 + 2);
+			break;
+		case 0x3C:
+			err = handle_open(cpu, "w+b");
+			break;
+		case 0x3D:
+			err = (cpu->ax.l & 7) > 2 ? ERR_ACCESS
+				: handle_open(cpu, modes[cpu->ax.l & 7]);
+			break;
+		case 0x3E:
+			err = handle_close(cpu);
+			break;
+		case 0x3F:
+			err = handle_rw(cpu, 0);
+			break;
+		case 0x40:
+			err = handle_rw(cpu, 1);
+			break;
+		case 0x41:
+			err = file_delete(cpu);
+			break;
+		case 0x42:
+			err = handle_seek(cpu);
+			break;
+		case 0x44:
+			err = handle_info(cpu);
+			break;
+		case 0x48:
+			err = mem_alloc(cpu);
+			break;
+		case 0x49:
+			err = mem_release(cpu);
+			break;
+		case 0x4A:
+			err = mem_resize(cpu);
+			break;
+		case 0x4C:
+			terminate(cpu, cpu->ax.l);
+			break;
+		case 0x51:
+		case 0x62:
+			cpu->bx.w = dos->psp;
+			break;
+		default:
+			err = ERR_FUNCTION;
+			break;
+	}
+	if (err)
+	{
+		cpu->ax.w = err;
+		set_flag(cpu, FLAGS_CF);
+	}
+	return 1;
+}
+
+//returns 1 if serviced, nothing to do until a program is loaded
+int dos_hle(X86Cpu *cpu, uint8_t vector)
+{
+	if (cpu->dos->psp == 0)
+		return 0;
+	if (vector == 0x20)
+	{
+		terminate(cpu, 0);
+		return 1;
+	}
+	return int21(cpu);
+}
+
+//open files are host state, no snapshot can carry or rewind them
+int dos_files_open(X86Cpu *cpu)
+{
+	int h;
+
+	for (h = DOS_FIRST_FILE; h < DOS_HANDLES; h++)
+		if (cpu->dos->file[h])
+			return 1;
+	return 0;
+}
+
+int dos_exit_code(X86Cpu *cpu)
+{
+	return cpu->dos->exit_code;
+}
@@ -0,0 +1,54 @@
+#ifndef DOS_H
+#define DOS_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include "intel8086.h"
+
+/* Just enough of DOS to run a .COM or MZ .EXE without booting anything.
+ * dos_load puts the program and a PSP straight into RAM, points the vectors
+ * at a stub IRET in ROM and INT 20h and 21h at trap stubs, which are then
+ * serviced in C like the BIOS HLE.  The memory arena is a real MCB chain in guest
+ * RAM.  Handles are host stdio streams: 0-2 the console, the rest files
+ * under one host directory, outside of which no path can reach. */
+#define DOS_FREE_SEG 0x0100	//first paragraph of the arena
+#define DOS_STUB 0xFFF53	//F000:FF53, an IRET in the IBM ROM as well
+#define DOS_TRAP 0xF0010	//INT 20h stub, INT 21h's 4 bytes on, blank ROM
+#define DOS_COM_MAX 0xFF00	//a .COM and its stack share one 64K segment
+#define DOS_HANDLES 20
+#define DOS_FIRST_FILE 5	//0-4 are CON, CON, CON, AUX and PRN
+
+typedef struct Dos {
+	uint16_t psp;		//0 until a program is loaded
+	int exit_code;		//-1 while it runs
+	FILE *con;		//console output
+	FILE *in;		//console input, read through its descriptor
+	int ahead;		//byte read by a status check, EOF for none
+	char *root;		//host directory for files, NULL allows none
+	FILE *file[DOS_HANDLES];
+	//stdio has to seek between a read and a write on the same stream
+	uint8_t writing[DOS_HANDLES];
+} Dos;
+
+int dos_init(X86Cpu *cpu);
+void dos_free(X86Cpu *cpu);
+int dos_load(X86Cpu *cpu, const char *filename, const char *args);
+int dos_hle(X86Cpu *cpu, uint8_t vector);
+int dos_exit_code(X86Cpu *cpu);
+int dos_files_open(X86Cpu *cpu);
+int dos_set_root(X86Cpu *cpu, const char *dir);
+
+#endif
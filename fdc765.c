@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intel8086.h"
+#include "fdc765.h"
+#include "floppy.h"
+#include "dma8237.h"
+#include "pic8259.h"
+#include "io.h"
+#include "sched.h"
+
+/* NEC uPD765 as wired on the 5150 diskette adapter: DMA channel 2, IRQ 6,
+ * double density 512 byte sectors only.  A command that moves the head or
+ * waits for the disk finishes in one scheduler event, timed from the step
+ * rate and from where the disk has turned to by X86Cpu.cycles, and all of
+ * its data crosses the DMA controller then.  With Floppy.instant set every
+ * command takes FDC_INSTANT_CYCLES instead.  The scan commands are not
+ * implemented, nothing on a PC uses them. */
+
+#define CMD_READ_TRACK		0x02
+#define CMD_SPECIFY		0x03
+#define CMD_SENSE_DRIVE		0x04
+#define CMD_WRITE		0x05
+#define CMD_READ		0x06
+#define CMD_RECALIBRATE		0x07
+#define CMD_SENSE_INT		0x08
+#define CMD_WRITE_DELETED	0x09
+#define CMD_READ_ID		0x0A
+#define CMD_READ_DELETED	0x0C
+#define CMD_FORMAT		0x0D
+#define CMD_SEEK		0x0F
+//not a command, the interrupt after reset
+#define CMD_RESET		0xFF
+
+#define ST0_INVALID	0x80
+#define ST0_ABNORMAL	0x40
+#define ST0_SEEK_END	0x20
+#define ST0_NOT_READY	0x08
+#define ST1_END_CYL	0x80
+#define ST1_OVERRUN	0x10
+#define ST1_NO_DATA	0x04
+#define ST1_NOT_WRITABLE 0x02
+#define ST1_NO_ADDR	0x01
+#define ST2_WRONG_CYL	0x10
+#define ST3_READY	0x20
+#define ST3_TRACK0	0x10
+#define ST3_TWO_SIDE	0x08
+
+//bytes in each command, 0 for invalid ones
+static const uint8_t cmd_len[32] = {
+	[CMD_READ_TRACK] = 9, [CMD_SPECIFY] = 3, [CMD_SENSE_DRIVE] = 2,
+	[CMD_WRITE] = 9, [CMD_READ] = 9, [CMD_RECALIBRATE] = 2,
+	[CMD_SENSE_INT] = 1, [CMD_WRITE_DELETED] = 9, [CMD_READ_ID] = 2,
+	[CMD_READ_DELETED] = 9, [CMD_FORMAT] = 6, [CMD_SEEK] = 3,
+};
+
+//the line only reaches the PIC while the DOR enables it
+static void fdc_irq(X86Cpu *cpu, int level)
+{
+	cpu->fdc.irq = level;
+	pic_irq(cpu, FDC_IRQ, level && (cpu->fdc.dor & FDC_DOR_DMA));
+}
+
+static void fdc_result(X86Cpu *cpu, int len)
+{
+	cpu->fdc.phase = FDC_RESULT;
+	cpu->fdc.res_len = len;
+	cpu->fdc.res_pos = 0;
+}
+
+static uint64_t fdc_delay(X86Cpu *cpu, uint64_t cycles)
+{
+	if (cpu->floppy->instant || cycles < FDC_INSTANT_CYCLES)
+		return FDC_INSTANT_CYCLES;
+	return cycles;
+}
+
+//until sector s comes under the head, plus n sectors passing
+static uint64_t fdc_rotation(X86Cpu *cpu, FloppyImage *img, int s, int n)
+{
+	uint64_t per, pos;
+
+	if (img->base == NULL)
+		return 0;
+	per = FDC_REV_CYCLES / img->sectors;
+	pos = cpu->cycles % FDC_REV_CYCLES;
+	return ((s - 1) * per + FDC_REV_CYCLES - pos) % FDC_REV_CYCLES + n * per;
+}
+
+//terminal count masks the channel, so does the BIOS when it is done
+static int fdc_tc(X86Cpu *cpu)
+{
+	return cpu->dma.mask & 1 << FDC_DMA;
+}
+
+/* Read and write data, and read track.  Sectors on one track that come
+ * from the same place are handed to the DMA controller in one go, so a
+ * multi-sector read from an unwritten disk is a single copy out of the
+ * image's mapping. */
+static void fdc_transfer(X86Cpu *cpu)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	uint8_t op = fdc->cmd[0] & 0x1F;
+	int drive = fdc->cmd[1] & 3, hd = fdc->cmd[1] >> 2 & 1;
+	int mt = fdc->cmd[0] & 0x80 && op != CMD_READ_TRACK;
+	int c = fdc->cmd[2], h = fdc->cmd[3], s = fdc->cmd[4];
+	int eot = fdc->cmd[6];
+	int write = op == CMD_WRITE || op == CMD_WRITE_DELETED;
+	FloppyImage *img = &cpu->floppy->drive[drive];
+	uint8_t st0 = 0, st1 = 0, st2 = 0;
+	const uint8_t *src;
+	uint8_t *dst;
+	uint32_t got;
+	int run, k, tc;
+
+	if (op == CMD_READ_TRACK)
+		s = 1;
+	if (img->base == NULL)
+		st0 = ST0_ABNORMAL | ST0_NOT_READY;
+	else if (!(fdc->dor & FDC_DOR_DMA) || fdc_tc(cpu))
+	{
+		st0 = ST0_ABNORMAL;
+		st1 = ST1_OVERRUN;
+	}
+	while (!st0)
+	{
+		src = floppy_read(img, fdc->pcn[drive], hd, s, &run);
+		if (src == NULL || c != fdc->pcn[drive] || fdc->cmd[5] != 2)
+		{
+			st0 = ST0_ABNORMAL;
+			st1 = ST1_NO_DATA;
+			if (c != fdc->pcn[drive])
+				st2 = ST2_WRONG_CYL;
+			break;
+		}
+		if (write)
+		{
+			dst = floppy_write(img, c, hd, s);
+			if (dst == NULL)
+			{
+				st0 = ST0_ABNORMAL;
+				st1 = ST1_NOT_WRITABLE;
+				break;
+			}
+			got = dma_read_mem(cpu, FDC_DMA, dst, FLOPPY_SECTOR);
+			//a sector cut short by terminal count is padded out
+			memset(dst + got, 0, FLOPPY_SECTOR - got);
+			k = 1;
+		}
+		else
+		{
+			k = eot - s + 1;
+			if (k > run)
+				k = run;
+			if (k < 1)
+				k = 1;
+			got = dma_write_mem(cpu, FDC_DMA, src, k * FLOPPY_SECTOR);
+			if (got < (uint32_t)k * FLOPPY_SECTOR)
+				k = got ? (got + FLOPPY_SECTOR - 1) / FLOPPY_SECTOR : 1;
+		}
+
+		//s moves on past the last sector done, as the result reports it
+		s += k - 1;
+		tc = fdc_tc(cpu);
+		if (s < eot)
+			s++;
+		else if (mt && hd == 0)
+		{
+			hd = 1;
+			h ^= 1;
+			s = 1;
+		}
+		else
+		{
+			c++;
+			if (mt)
+			{
+				hd = 0;
+				h ^= 1;
+			}
+			s = 1;
+			if (!tc)
+			{
+				st0 = ST0_ABNORMAL;
+				st1 = ST1_END_CYL;
+			}
+			break;
+		}
+		if (tc)
+			break;
+	}
+
+	fdc->res[0] = st0 | hd << 2 | drive;
+	fdc->res[1] = st1;
+	fdc->res[2] = st2;
+	fdc->res[3] = c;
+	fdc->res[4] = h;
+	fdc->res[5] = s;
+	fdc->res[6] = fdc->cmd[5];
+	fdc_result(cpu, 7);
+	fdc_irq(cpu, 1);
+}
+
+//the ID of whichever sector comes round next
+static void fdc_read_id(X86Cpu *cpu)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	int drive = fdc->cmd[1] & 3, hd = fdc->cmd[1] >> 2 & 1;
+	FloppyImage *img = &cpu->floppy->drive[drive];
+	uint8_t st0 = 0, st1 = 0;
+	int s = 1;
+
+	if (img->base == NULL)
+		st0 = ST0_ABNORMAL | ST0_NOT_READY;
+	else if (hd >= img->heads || fdc->pcn[drive] >= img->cylinders)
+	{
+		st0 = ST0_ABNORMAL;
+		st1 = ST1_NO_ADDR;
+	}
+	else
+		s = cpu->cycles % FDC_REV_CYCLES
+			/ (FDC_REV_CYCLES / img->sectors) % img->sectors + 1;
+
+	fdc->res[0] = st0 | hd << 2 | drive;
+	fdc->res[1] = st1;
+	fdc->res[2] = 0;
+	fdc->res[3] = fdc->pcn[drive];
+	fdc->res[4] = hd;
+	fdc->res[5] = s;
+	fdc->res[6] = 2;
+	fdc_result(cpu, 7);
+	fdc_irq(cpu, 1);
+}
+
+/* Each sector's C H R N comes over DMA; the filler byte lands in the
+ * overlay for every sector the image has room for. */
+static void fdc_format(X86Cpu *cpu)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	int drive = fdc->cmd[1] & 3, hd = fdc->cmd[1] >> 2 & 1;
+	FloppyImage *img = &cpu->floppy->drive[drive];
+	uint8_t st0 = 0, st1 = 0, id[4] = { 0 };
+	uint8_t *dst;
+	int i;
+
+	if (img->base == NULL)
+		st0 = ST0_ABNORMAL | ST0_NOT_READY;
+	else if (!(fdc->dor & FDC_DOR_DMA))
+	{
+		st0 = ST0_ABNORMAL;
+		st1 = ST1_OVERRUN;
+	}
+	for (i = 0; !st0 && i < fdc->cmd[3]; i++)
+	{
+		if (dma_read_mem(cpu, FDC_DMA, id, 4) < 4)
+			break;
+		dst = floppy_write(img, fdc->pcn[drive], hd, id[2]);
+		if (dst)
+			memset(dst, fdc->cmd[5], FLOPPY_SECTOR);
+	}
+
+	fdc->res[0] = st0 | hd << 2 | drive;
+	fdc->res[1] = st1;
+	fdc->res[2] = 0;
+	memcpy(&fdc->res[3], id, 4);
+	fdc_result(cpu, 7);
+	fdc_irq(cpu, 1);
+}
+
+static void fdc_event(X86Cpu *cpu)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	uint8_t op = fdc->busy;
+	int i;
+
+	fdc->busy = 0;
+	switch (op)
+	{
+		case CMD_RESET:
+			for (i = 0; i < FDC_DRIVES; i++)
+				fdc->sense[i] = 0xC0 | i;
+			fdc_irq(cpu, 1);
+			break;
+		case CMD_SEEK:
+		case CMD_RECALIBRATE:
+			for (i = 0; i < FDC_DRIVES; i++)
+			{
+				if (!(fdc->seeking & 1 << i))
+					continue;
+				fdc->pcn[i] = fdc->target;
+				fdc->sense[i] = ST0_SEEK_END | i;
+			}
+			fdc->seeking = 0;
+			fdc_irq(cpu, 1);
+			break;
+		case CMD_READ_ID:
+			fdc_read_id(cpu);
+			break;
+		case CMD_FORMAT:
+			fdc_format(cpu);
+			break;
+		default:
+			fdc_transfer(cpu);
+	}
+}
+
+//one event slot, so a seek still under way ends now
+static void fdc_finish(X86Cpu *cpu)
+{
+	if (!cpu->fdc.busy)
+		return;
+	sched_cancel(cpu, SCHED_FDC);
+	fdc_event(cpu);
+}
+
+static void fdc_start(X86Cpu *cpu, uint8_t op, uint64_t cycles)
+{
+	fdc_finish(cpu);
+	cpu->fdc.busy = op;
+	sched_at(cpu, SCHED_FDC, cpu->cycles + fdc_delay(cpu, cycles));
+}
+
+static void fdc_command(X86Cpu *cpu)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	uint8_t op = fdc->cmd[0] & 0x1F;
+	int drive = fdc->cmd[1] & 3, hd = fdc->cmd[1] >> 2 & 1;
+	FloppyImage *img = &cpu->floppy->drive[drive];
+	uint64_t ms_per_step = 2 * (16 - fdc->srt);
+	uint32_t left, n;
+	int i;
+
+	switch (op)
+	{
+		case CMD_SPECIFY:
+			fdc->srt = fdc->cmd[1] >> 4;
+			break;
+		case CMD_SENSE_DRIVE:
+			fdc->res[0] = ST3_READY | (fdc->cmd[1] & 7);
+			if (fdc->pcn[drive] == 0)
+				fdc->res[0] |= ST3_TRACK0;
+			if (img->heads == 2)
+				fdc->res[0] |= ST3_TWO_SIDE;
+			fdc_result(cpu, 1);
+			break;
+		case CMD_SENSE_INT:
+			for (i = 0; i < FDC_DRIVES && !fdc->sense[i]; i++)
+				;
+			if (i == FDC_DRIVES)
+			{
+				fdc->res[0] = ST0_INVALID;
+				fdc_result(cpu, 1);
+				break;
+			}
+			fdc->res[0] = fdc->sense[i];
+			fdc->res[1] = fdc->pcn[i];
+			fdc->sense[i] = 0;
+			fdc_result(cpu, 2);
+			fdc_irq(cpu, 0);
+			break;
+		case CMD_RECALIBRATE:
+		case CMD_SEEK:
+			fdc_finish(cpu);
+			fdc->target = op == CMD_SEEK ? fdc->cmd[2] : 0;
+			n = abs(fdc->target - fdc->pcn[drive]);
+			fdc->seeking |= 1 << drive;
+			fdc_start(cpu, op, (n * ms_per_step + FDC_SETTLE_MS)
+				* FDC_CYCLES_PER_MS);
+			break;
+		case CMD_READ_ID:
+			fdc->phase = FDC_EXEC;
+			fdc_start(cpu, op, fdc_rotation(cpu, img,
+				cpu->cycles % FDC_REV_CYCLES * img->sectors
+				/ FDC_REV_CYCLES + 2, 0));
+			break;
+		case CMD_FORMAT:
+			fdc->phase = FDC_EXEC;
+			fdc_start(cpu, op, fdc_rotation(cpu, img, 1, img->sectors));
+			break;
+		default:
+			//as many sectors as the DMA count asks for, up to EOT
+			left = (cpu->dma.ch[FDC_DMA].count + 1 + FLOPPY_SECTOR - 1)
+				/ FLOPPY_SECTOR;
+			n = fdc->cmd[6] >= fdc->cmd[4] ? fdc->cmd[6] - fdc->cmd[4] + 1 : 1;
+			if (fdc->cmd[0] & 0x80 && hd == 0)
+				n += fdc->cmd[6];
+			fdc->phase = FDC_EXEC;
+			fdc_start(cpu, op, fdc_rotation(cpu, img,
+				op == CMD_READ_TRACK ? 1 : fdc->cmd[4],
+				n < left ? n : left));
+	}
+}
+
+uint8_t fdc_read(X86Cpu *cpu, uint16_t port)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	uint8_t val;
+
+	if (!(fdc->dor & FDC_DOR_RESET))
+		return port == FDC_PORT + 4 ? 0 : 0xFF;
+	switch (port - FDC_PORT)
+	{
+		case 4:
+			val = fdc->seeking;
+			if (fdc->phase == FDC_IDLE)
+				val |= FDC_MSR_RQM | (fdc->cmd_pos ? FDC_MSR_BUSY : 0);
+			else if (fdc->phase == FDC_EXEC)
+				val |= FDC_MSR_BUSY;
+			else
+				val |= FDC_MSR_RQM | FDC_MSR_DIO | FDC_MSR_BUSY;
+			return val;
+		case 5:
+			if (fdc->phase != FDC_RESULT)
+				return 0xFF;
+			val = fdc->res[fdc->res_pos++];
+			//reading the result acknowledges a data command's interrupt
+			if (fdc->res_pos == 1 && fdc->irq)
+				fdc_irq(cpu, 0);
+			if (fdc->res_pos == fdc->res_len)
+				fdc->phase = FDC_IDLE;
+			return val;
+		default:
+			return 0xFF;
+	}
+}
+
+void fdc_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	Fdc765 *fdc = &cpu->fdc;
+	uint8_t old = fdc->dor;
+
+	if (port == FDC_PORT + 2)
+	{
+		fdc->dor = val;
+		if (!(val & FDC_DOR_RESET))
+		{
+			sched_cancel(cpu, SCHED_FDC);
+			fdc->phase = FDC_IDLE;
+			fdc->cmd_pos = 0;
+			fdc->busy = 0;
+			fdc->seeking = 0;
+			memset(fdc->sense, 0, sizeof(fdc->sense));
+			fdc->irq = 0;
+		}
+		else if (!(old & FDC_DOR_RESET))
+		{
+			fdc->busy = CMD_RESET;
+			sched_at(cpu, SCHED_FDC, cpu->cycles + FDC_INSTANT_CYCLES);
+		}
+		fdc_irq(cpu, fdc->irq);
+		return;
+	}
+	if (port != FDC_PORT + 5 || !(fdc->dor & FDC_DOR_RESET)
+		|| fdc->phase != FDC_IDLE)
+		return;
+
+	if (fdc->cmd_pos == 0)
+	{
+		fdc->cmd_len = cmd_len[val & 0x1F];
+		if (fdc->cmd_len == 0)
+		{
+			fdc->res[0] = ST0_INVALID;
+			fdc_result(cpu, 1);
+			return;
+		}
+	}
+	fdc->cmd[fdc->cmd_pos++] = val;
+	if (fdc->cmd_pos == fdc->cmd_len)
+	{
+		fdc->cmd_pos = 0;
+		fdc_command(cpu);
+	}
+}
+
+static const IoHandler fdc_ports = { fdc_read, fdc_write, NULL, NULL };
+
+void fdc_init(X86Cpu *cpu)
+{
+	memset(&cpu->fdc, 0, sizeof(Fdc765));
+	io_register(cpu, FDC_PORT + 2, 4, &fdc_ports);
+	sched_register(cpu, SCHED_FDC, fdc_event);
+}
@@ -0,0 +1,68 @@
+#ifndef FDC765_H
+#define FDC765_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+struct X86Cpu;
+
+//digital output register at 3F2h, status 3F4h and data 3F5h
+#define FDC_PORT 0x3F0
+#define FDC_IRQ 6
+#define FDC_DMA 2
+#define FDC_DRIVES 4
+
+//digital output register
+#define FDC_DOR_RESET	0x04	//low holds the controller in reset
+#define FDC_DOR_DMA	0x08	//enables the DRQ and IRQ lines
+
+//main status register
+#define FDC_MSR_RQM	0x80	//ready for a byte
+#define FDC_MSR_DIO	0x40	//controller to cpu
+#define FDC_MSR_BUSY	0x10
+
+//command, execution and result phases
+#define FDC_IDLE	0
+#define FDC_EXEC	1
+#define FDC_RESULT	2
+
+//300 rpm, 4.77MHz
+#define FDC_CYCLES_PER_MS 4773
+#define FDC_REV_CYCLES (200 * FDC_CYCLES_PER_MS)
+#define FDC_SETTLE_MS 15
+//how long every command takes with instant seeking
+#define FDC_INSTANT_CYCLES 200
+
+typedef struct {
+	uint8_t dor;
+	uint8_t phase;
+	uint8_t cmd[9];
+	uint8_t cmd_len, cmd_pos;
+	uint8_t res[7];
+	uint8_t res_len, res_pos;
+	uint8_t pcn[FDC_DRIVES];	//present cylinder of each drive
+	uint8_t sense[FDC_DRIVES];	//ST0 for SENSE INTERRUPT, 0 if none
+	uint8_t seeking;		//drives with a seek in progress
+	uint8_t target;			//cylinder they are seeking to
+	uint8_t busy;			//command the pending event finishes
+	uint8_t srt;			//step rate from SPECIFY
+	uint8_t irq;
+} Fdc765;
+
+void fdc_init(struct X86Cpu *cpu);
+uint8_t fdc_read(struct X86Cpu *cpu, uint16_t port);
+void fdc_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+
+#endif
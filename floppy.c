@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "floppy.h"
+
+//the image size is all there is to tell the formats apart
+static const struct {
+	size_t size;
+	uint8_t cylinders, heads, sectors;
+} formats[] = {
+	{ 163840, 40, 1, 8 },
+	{ 184320, 40, 1, 9 },
+	{ 327680, 40, 2, 8 },
+	{ 368640, 40, 2, 9 },
+};
+
+int floppy_init(X86Cpu *cpu)
+{
+	cpu->floppy = calloc(1, sizeof(Floppy));
+	return cpu->floppy ? 0 : -1;
+}
+
+void floppy_free(X86Cpu *cpu)
+{
+	int i;
+
+	if (cpu->floppy == NULL)
+		return;
+	for (i = 0; i < FLOPPY_DRIVES; i++)
+		floppy_eject(cpu, i);
+	free(cpu->floppy);
+	cpu->floppy = NULL;
+}
+
+int floppy_insert(X86Cpu *cpu, int drive, const char *filename)
+{
+	FloppyImage *img;
+	struct stat st;
+	void *base;
+	size_t i, count;
+	int fd;
+
+	if (drive < 0 || drive >= FLOPPY_DRIVES)
+		return -1;
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "disk image %s not found!\n", filename);
+		return -1;
+	}
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		if ((size_t)st.st_size == formats[i].size)
+			break;
+	if (i == sizeof(formats) / sizeof(formats[0]))
+	{
+		fprintf(stderr, "%s: not a 160K, 180K, 320K or 360K image\n",
+			filename);
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+
+	floppy_eject(cpu, drive);
+	img = &cpu->floppy->drive[drive];
+	count = st.st_size / FLOPPY_SECTOR;
+	img->overlay = calloc(count, sizeof(uint8_t *));
+	if (img->overlay == NULL)
+	{
+		munmap(base, st.st_size);
+		return -1;
+	}
+	img->base = base;
+	img->size = st.st_size;
+	img->cylinders = formats[i].cylinders;
+	img->heads = formats[i].heads;
+	img->sectors = formats[i].sectors;
+	return 0;
+}
+
+//anything written to the disk goes with it
+void floppy_eject(X86Cpu *cpu, int drive)
+{
+	FloppyImage *img;
+	size_t i;
+
+	if (drive < 0 || drive >= FLOPPY_DRIVES)
+		return;
+	img = &cpu->floppy->drive[drive];
+	if (img->base == NULL)
+		return;
+	for (i = 0; i < img->size / FLOPPY_SECTOR; i++)
+		free(img->overlay[i]);
+	free(img->overlay);
+	munmap((void *)img->base, img->size);
+	memset(img, 0, sizeof(FloppyImage));
+}
+
+static long floppy_lba(FloppyImage *img, int c, int h, int s)
+{
+	if (img->base == NULL || c >= img->cylinders || h >= img->heads
+		|| s < 1 || s > img->sectors)
+		return -1;
+	return ((long)c * img->heads + h) * img->sectors + s - 1;
+}
+
+/* Sector s of a track, or NULL if there is none.  run gets how many
+ * sectors from s onwards on the same track follow it in memory, so a
+ * multi-sector read can be handed over in one piece. */
+const uint8_t *floppy_read(FloppyImage *img, int c, int h, int s, int *run)
+{
+	long lba = floppy_lba(img, c, h, s);
+	int n;
+
+	if (lba < 0)
+		return NULL;
+	if (img->overlay[lba])
+	{
+		*run = 1;
+		return img->overlay[lba];
+	}
+	for (n = 1; s + n <= img->sectors && !img->overlay[lba + n]; n++)
+		;
+	*run = n;
+	return img->base + lba * FLOPPY_SECTOR;
+}
+
+//the sector's private copy, made on first use; NULL if there is no such sector
+uint8_t *floppy_write(FloppyImage *img, int c, int h, int s)
+{
+	long lba = floppy_lba(img, c, h, s);
+	uint8_t *sec;
+
+	if (lba < 0)
+		return NULL;
+	if (img->overlay[lba] == NULL)
+	{
+		sec = malloc(FLOPPY_SECTOR);
+		if (sec == NULL)
+			return NULL;
+		memcpy(sec, img->base + lba * FLOPPY_SECTOR, FLOPPY_SECTOR);
+		img->overlay[lba] = sec;
+	}
+	return img->overlay[lba];
+}
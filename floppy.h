@@ -0,0 +1,49 @@
+#ifndef FLOPPY_H
+#define FLOPPY_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "intel8086.h"
+
+/* Host side of the floppy drives.  An image file is mapped read only and
+ * never written: the first write to a sector gives that sector a private
+ * copy in the overlay, later reads of it come from there.  Everything else
+ * is handed to the controller as a pointer into the mapping, so a read is
+ * one copy from the page cache into guest RAM.  The overlay lives as long
+ * as the disk is in the drive and is not part of a snapshot. */
+#define FLOPPY_DRIVES 4
+#define FLOPPY_SECTOR 512
+
+typedef struct {
+	const uint8_t *base;	//NULL when the drive is empty
+	size_t size;
+	uint8_t **overlay;	//a sector's own copy once written
+	uint8_t cylinders, heads, sectors;
+} FloppyImage;
+
+typedef struct Floppy {
+	FloppyImage drive[FLOPPY_DRIVES];
+	int instant;		//no seek or rotation delays
+} Floppy;
+
+int floppy_init(X86Cpu *cpu);
+void floppy_free(X86Cpu *cpu);
+int floppy_insert(X86Cpu *cpu, int drive, const char *filename);
+void floppy_eject(X86Cpu *cpu, int drive);
+const uint8_t *floppy_read(FloppyImage *img, int c, int h, int s, int *run);
+uint8_t *floppy_write(FloppyImage *img, int c, int h, int s);
+
+#endif
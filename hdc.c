@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intel8086.h"
+#include "hdc.h"
+#include "hdimage.h"
+#include "dma8237.h"
+#include "pic8259.h"
+#include "io.h"
+#include "sched.h"
+
+/* The XT fixed disk adapter, a Xebec S1410 behind a four port interface.
+ * The cpu selects the controller, writes a six byte command block a byte
+ * at a time as the status register asks for them, and after the command's
+ * interrupt reads one completion byte.  Like the floppy controller,
+ * anything that waits on the drive finishes in a single scheduler event
+ * that moves all of its sectors through DMA channel 3.  Formatting only
+ * checks the address: what is on the image stays there. */
+
+#define CMD_TEST_READY		0x00
+#define CMD_RECALIBRATE		0x01
+#define CMD_SENSE		0x03
+#define CMD_FORMAT_DRIVE	0x04
+#define CMD_VERIFY		0x05
+#define CMD_FORMAT_TRACK	0x06
+#define CMD_FORMAT_BAD		0x07
+#define CMD_READ		0x08
+#define CMD_WRITE		0x0A
+#define CMD_SEEK		0x0B
+#define CMD_INIT_DRIVE		0x0C
+#define CMD_ECC_BURST		0x0D
+#define CMD_READ_BUFFER		0x0E
+#define CMD_WRITE_BUFFER	0x0F
+#define CMD_RAM_DIAG		0xE0
+#define CMD_DRIVE_DIAG		0xE3
+#define CMD_CTRL_DIAG		0xE4
+
+//sense error codes
+#define ERR_NOT_READY		0x04
+#define ERR_WRITE_FAULT		0x03
+#define ERR_BAD_COMMAND		0x20
+#define ERR_BAD_ADDRESS		0x21
+
+static HdImage *hdc_image(X86Cpu *cpu)
+{
+	return &cpu->hdisk->drive[cpu->hdc.dcb[1] >> 5 & 1];
+}
+
+static void hdc_irq(X86Cpu *cpu, int level)
+{
+	cpu->hdc.irq = level;
+	pic_irq(cpu, HDC_IRQ, level && (cpu->hdc.mask & HDC_MASK_IRQ));
+}
+
+static void hdc_done(X86Cpu *cpu, uint8_t err)
+{
+	Hdc *hdc = &cpu->hdc;
+
+	hdc->sense[0] = err;
+	hdc->result = (err ? 0x02 : 0) | (hdc->dcb[1] & 0x20);
+	hdc->phase = HDC_STATUS;
+	hdc_irq(cpu, 1);
+}
+
+static uint64_t hdc_delay(X86Cpu *cpu, uint64_t cycles)
+{
+	if (cpu->hdisk->instant || cycles < HDC_INSTANT_CYCLES)
+		return HDC_INSTANT_CYCLES;
+	return cycles;
+}
+
+static uint16_t hdc_cylinder(X86Cpu *cpu)
+{
+	return (cpu->hdc.dcb[2] & 0xC0) << 2 | cpu->hdc.dcb[3];
+}
+
+//-1 if the command block names a sector the drive does not have
+static long hdc_lba(X86Cpu *cpu, HdImage *img)
+{
+	uint8_t *dcb = cpu->hdc.dcb;
+	int head = dcb[1] & 0x1F, sector = dcb[2] & 0x3F;
+	uint16_t cyl = hdc_cylinder(cpu);
+
+	if (cyl >= img->hdr.cylinders || head >= img->hdr.heads
+		|| sector >= HD_SECTORS)
+		return -1;
+	return ((long)cyl * img->hdr.heads + head) * HD_SECTORS + sector;
+}
+
+//seeking to the command's cylinder and then n sectors passing the head
+static uint64_t hdc_time(X86Cpu *cpu, uint16_t cyl, int n)
+{
+	Hdc *hdc = &cpu->hdc;
+	uint64_t per = HDC_REV_CYCLES / HD_SECTORS;
+	uint64_t pos, t = 0;
+	int steps = abs(cyl - hdc->cyl[hdc->dcb[1] >> 5 & 1]);
+
+	if (steps)
+		t = (uint64_t)steps * HDC_STEP_US * HDC_CYCLES_PER_MS / 1000
+			+ HDC_SETTLE_MS * HDC_CYCLES_PER_MS;
+	if (n)
+	{
+		pos = (cpu->cycles + t) % HDC_REV_CYCLES;
+		t += ((hdc->dcb[2] & 0x3F) * per + HDC_REV_CYCLES - pos)
+			% HDC_REV_CYCLES + n * per;
+	}
+	return t;
+}
+
+/* Up to the block count, or fewer if DMA reaches terminal count first.
+ * Reads go over in runs of sectors that sit together in the image. */
+static uint8_t hdc_transfer(X86Cpu *cpu, HdImage *img, int write)
+{
+	Hdc *hdc = &cpu->hdc;
+	uint32_t lba = hdc_lba(cpu, img);
+	uint32_t left = hdc->dcb[4] ? hdc->dcb[4] : 256;
+	uint32_t run, got;
+	const uint8_t *src;
+	uint8_t *dst;
+	uint8_t err = 0;
+
+	while (left && (hdc->mask & HDC_MASK_DMA))
+	{
+		if (write)
+		{
+			dst = hd_write(img, lba);
+			if (dst == NULL)
+			{
+				err = lba < hd_sectors(img) ? ERR_WRITE_FAULT
+					: ERR_BAD_ADDRESS;
+				break;
+			}
+			got = dma_read_mem(cpu, HDC_DMA, dst, HD_SECTOR);
+			if (got == 0)
+				break;
+			memset(dst + got, 0, HD_SECTOR - got);
+			if (hd_flush(img, lba) != 0)
+			{
+				err = ERR_WRITE_FAULT;
+				break;
+			}
+			run = 1;
+		}
+		else
+		{
+			src = hd_read(img, lba, &run);
+			if (src == NULL)
+			{
+				err = ERR_BAD_ADDRESS;
+				break;
+			}
+			if (run > left)
+				run = left;
+			got = dma_write_mem(cpu, HDC_DMA, src, run * HD_SECTOR);
+			if (got < run * HD_SECTOR)
+				left = run = (got + HD_SECTOR - 1) / HD_SECTOR;
+		}
+		lba += run;
+		left -= run;
+	}
+	hdc->cyl[hdc->dcb[1] >> 5 & 1] = (lba - 1) / HD_SECTORS / img->hdr.heads;
+	return err;
+}
+
+static void hdc_event(X86Cpu *cpu)
+{
+	Hdc *hdc = &cpu->hdc;
+	HdImage *img = hdc_image(cpu);
+	int drive = hdc->dcb[1] >> 5 & 1;
+	uint8_t err = 0;
+
+	switch (hdc->dcb[0])
+	{
+		case CMD_RECALIBRATE:
+		case CMD_FORMAT_DRIVE:
+			hdc->cyl[drive] = 0;
+			break;
+		case CMD_READ:
+			err = hdc_transfer(cpu, img, 0);
+			break;
+		case CMD_WRITE:
+			err = hdc_transfer(cpu, img, 1);
+			break;
+		case CMD_READ_BUFFER:
+			dma_write_mem(cpu, HDC_DMA, hdc->buffer, sizeof(hdc->buffer));
+			break;
+		case CMD_WRITE_BUFFER:
+			dma_read_mem(cpu, HDC_DMA, hdc->buffer, sizeof(hdc->buffer));
+			break;
+		default:
+			hdc->cyl[drive] = hdc_cylinder(cpu);
+	}
+	hdc_done(cpu, err);
+}
+
+static void hdc_command(X86Cpu *cpu)
+{
+	Hdc *hdc = &cpu->hdc;
+	HdImage *img = hdc_image(cpu);
+	uint8_t op = hdc->dcb[0];
+	uint64_t t = 0;
+	int n;
+
+	if (op != CMD_SENSE)
+		memcpy(&hdc->sense[1], &hdc->dcb[1], 3);
+	switch (op)
+	{
+		case CMD_SENSE:
+			memcpy(hdc->data, hdc->sense, 4);
+			hdc->len = 4;
+			hdc->pos = 0;
+			hdc->phase = HDC_DATA_IN;
+			return;
+		case CMD_ECC_BURST:
+			hdc->data[0] = 0;
+			hdc->len = 1;
+			hdc->pos = 0;
+			hdc->phase = HDC_DATA_IN;
+			return;
+		case CMD_INIT_DRIVE:
+			//the drive's geometry, the image already has it
+			hdc->len = 8;
+			hdc->pos = 0;
+			hdc->phase = HDC_DATA_OUT;
+			return;
+		case CMD_RAM_DIAG:
+		case CMD_CTRL_DIAG:
+			hdc_done(cpu, 0);
+			return;
+		case CMD_READ_BUFFER:
+		case CMD_WRITE_BUFFER:
+			break;
+		case CMD_TEST_READY:
+		case CMD_DRIVE_DIAG:
+			hdc_done(cpu, img->base ? 0 : ERR_NOT_READY);
+			return;
+		case CMD_RECALIBRATE:
+		case CMD_FORMAT_DRIVE:
+			if (img->base == NULL)
+			{
+				hdc_done(cpu, ERR_NOT_READY);
+				return;
+			}
+			t = hdc_time(cpu, 0, 0);
+			break;
+		case CMD_VERIFY:
+		case CMD_FORMAT_TRACK:
+		case CMD_FORMAT_BAD:
+		case CMD_READ:
+		case CMD_WRITE:
+		case CMD_SEEK:
+			if (img->base == NULL || hdc_lba(cpu, img) < 0)
+			{
+				hdc_done(cpu, img->base ? ERR_BAD_ADDRESS
+					: ERR_NOT_READY);
+				return;
+			}
+			n = 0;
+			if (op == CMD_READ || op == CMD_WRITE || op == CMD_VERIFY)
+				n = hdc->dcb[4] ? hdc->dcb[4] : 256;
+			else if (op != CMD_SEEK)
+				n = HD_SECTORS;
+			t = hdc_time(cpu, hdc_cylinder(cpu), n);
+			break;
+		default:
+			hdc_done(cpu, ERR_BAD_COMMAND);
+			return;
+	}
+	hdc->phase = HDC_EXEC;
+	sched_at(cpu, SCHED_HDC, cpu->cycles + hdc_delay(cpu, t));
+}
+
+//drive 0's type in bits 2-3, drive 1's in bits 0-1
+static uint8_t hdc_jumpers(X86Cpu *cpu)
+{
+	HdImage *img;
+	uint8_t val = 0;
+	int d, t, type;
+
+	for (d = 0; d < HD_DRIVES; d++)
+	{
+		img = &cpu->hdisk->drive[d];
+		type = HD_TYPES - 1;
+		for (t = 0; img->base && t < HD_TYPES; t++)
+			if (hd_types[t][0] == img->hdr.cylinders
+				&& hd_types[t][1] == img->hdr.heads)
+				type = t;
+		val |= type << (d ? 0 : 2);
+	}
+	return val;
+}
+
+uint8_t hdc_read(X86Cpu *cpu, uint16_t port)
+{
+	static const uint8_t phase_status[] = {
+		[HDC_IDLE] = 0,
+		[HDC_CMD] = HDC_ST_BUSY | HDC_ST_CD | HDC_ST_REQ,
+		[HDC_DATA_OUT] = HDC_ST_BUSY | HDC_ST_REQ,
+		[HDC_DATA_IN] = HDC_ST_BUSY | HDC_ST_IO | HDC_ST_REQ,
+		[HDC_EXEC] = HDC_ST_BUSY,
+		[HDC_STATUS] = HDC_ST_BUSY | HDC_ST_CD | HDC_ST_IO | HDC_ST_REQ,
+	};
+	Hdc *hdc = &cpu->hdc;
+	uint8_t val;
+
+	switch (port - HDC_PORT)
+	{
+		case 0:
+			if (hdc->phase == HDC_DATA_IN)
+			{
+				val = hdc->data[hdc->pos++];
+				if (hdc->pos == hdc->len)
+				{
+					hdc->sense[0] = 0;
+					hdc_done(cpu, 0);
+				}
+				return val;
+			}
+			if (hdc->phase == HDC_STATUS)
+			{
+				hdc->phase = HDC_IDLE;
+				hdc_irq(cpu, 0);
+				return hdc->result;
+			}
+			return 0xFF;
+		case 1:
+			return phase_status[hdc->phase]
+				| (hdc->irq ? HDC_ST_IRQ : 0);
+		case 2:
+			return hdc_jumpers(cpu);
+		default:
+			return 0xFF;
+	}
+}
+
+void hdc_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	Hdc *hdc = &cpu->hdc;
+
+	switch (port - HDC_PORT)
+	{
+		case 0:
+			if (hdc->phase == HDC_CMD)
+			{
+				hdc->dcb[hdc->pos++] = val;
+				if (hdc->pos == sizeof(hdc->dcb))
+					hdc_command(cpu);
+			}
+			else if (hdc->phase == HDC_DATA_OUT)
+			{
+				hdc->data[hdc->pos++] = val;
+				if (hdc->pos == hdc->len)
+					hdc_done(cpu, 0);
+			}
+			break;
+		case 1:
+			sched_cancel(cpu, SCHED_HDC);
+			hdc->phase = HDC_IDLE;
+			hdc_irq(cpu, 0);
+			break;
+		case 2:
+			if (hdc->phase == HDC_EXEC)
+				break;
+			hdc->phase = HDC_CMD;
+			hdc->pos = 0;
+			hdc_irq(cpu, 0);
+			break;
+		case 3:
+			hdc->mask = val;
+			hdc_irq(cpu, hdc->irq);
+			break;
+	}
+}
+
+static const IoHandler hdc_ports = { hdc_read, hdc_write, NULL, NULL };
+
+void hdc_init(X86Cpu *cpu)
+{
+	memset(&cpu->hdc, 0, sizeof(Hdc));
+	io_register(cpu, HDC_PORT, 4, &hdc_ports);
+	sched_register(cpu, SCHED_HDC, hdc_event);
+}
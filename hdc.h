@@ -0,0 +1,69 @@
+#ifndef HDC_H
+#define HDC_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+struct X86Cpu;
+
+//data 320h, status/reset 321h, jumpers/select 322h, DMA and IRQ mask 323h
+#define HDC_PORT 0x320
+#define HDC_IRQ 5
+#define HDC_DMA 3
+
+//status register
+#define HDC_ST_REQ	0x01	//ready for the next byte
+#define HDC_ST_IO	0x02	//controller to cpu
+#define HDC_ST_CD	0x04	//command or completion status, not data
+#define HDC_ST_BUSY	0x08
+#define HDC_ST_IRQ	0x20
+
+//mask register
+#define HDC_MASK_DMA	0x01
+#define HDC_MASK_IRQ	0x02
+
+//what the controller expects on the data port next
+#define HDC_IDLE	0
+#define HDC_CMD		1	//the six byte command block
+#define HDC_DATA_OUT	2	//parameters from the cpu
+#define HDC_DATA_IN	3	//sense bytes to the cpu
+#define HDC_EXEC	4
+#define HDC_STATUS	5
+
+//3600 rpm, 4.77MHz
+#define HDC_CYCLES_PER_MS 4773
+#define HDC_REV_CYCLES (HDC_CYCLES_PER_MS * 50 / 3)
+#define HDC_STEP_US 200		//buffered seek, per cylinder
+#define HDC_SETTLE_MS 5
+#define HDC_INSTANT_CYCLES 200
+
+typedef struct {
+	uint8_t phase;
+	uint8_t mask;
+	uint8_t dcb[6];
+	uint8_t data[8];	//parameter or sense bytes
+	uint8_t pos, len;
+	uint8_t result;		//completion status byte
+	uint8_t sense[4];	//error and address of the last command
+	uint8_t irq;
+	uint16_t cyl[2];	//head position of each drive
+	uint8_t buffer[512];	//sector buffer, for its own diagnostics
+} Hdc;
+
+void hdc_init(struct X86Cpu *cpu);
+uint8_t hdc_read(struct X86Cpu *cpu, uint16_t port);
+void hdc_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+
+#endif
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hdimage.h"
+
+//the IBM fixed disk BIOS table, selected by the controller's jumpers
+const uint16_t hd_types[HD_TYPES][2] = {
+	{ 306, 2 }, { 375, 8 }, { 306, 6 }, { 306, 4 },
+};
+
+static uint32_t hd_clusters(uint32_t cylinders, uint32_t heads)
+{
+	return (cylinders * heads * HD_SECTORS + HD_CLUSTER_SECTORS - 1)
+		/ HD_CLUSTER_SECTORS;
+}
+
+//clusters start on the first boundary after the table
+static size_t hd_data_offset(uint32_t clusters)
+{
+	return (sizeof(HdHeader) + clusters * sizeof(uint32_t) + HD_CLUSTER - 1)
+		/ HD_CLUSTER * HD_CLUSTER;
+}
+
+//raw images are known by their size alone
+static int hd_raw_type(size_t size)
+{
+	int i;
+
+	for (i = 0; i < HD_TYPES; i++)
+		if (size == (size_t)hd_types[i][0] * hd_types[i][1]
+			* HD_SECTORS * HD_SECTOR)
+			return i;
+	return -1;
+}
+
+static uint64_t hd_new_id(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec)
+		^ (uint64_t)getpid() << 40) | 1;
+}
+
+int hd_init(X86Cpu *cpu)
+{
+	int i;
+
+	cpu->hdisk = calloc(1, sizeof(HardDisk));
+	if (cpu->hdisk == NULL)
+		return -1;
+	for (i = 0; i < HD_DRIVES; i++)
+		cpu->hdisk->drive[i].fd = -1;
+	return 0;
+}
+
+void hd_free(X86Cpu *cpu)
+{
+	int i;
+
+	if (cpu->hdisk == NULL)
+		return;
+	for (i = 0; i < HD_DRIVES; i++)
+		hd_detach(cpu, i);
+	free(cpu->hdisk);
+	cpu->hdisk = NULL;
+}
+
+uint32_t hd_sectors(HdImage *img)
+{
+	return (uint32_t)img->hdr.cylinders * img->hdr.heads * HD_SECTORS;
+}
+
+//where cluster c reads from, ignoring the overlay's file
+static const uint8_t *hd_cluster(HdImage *img, uint32_t c)
+{
+	if (img->over[c])
+		return img->over[c];
+	if (img->base_table == NULL)
+		return img->base + (size_t)c * HD_CLUSTER;
+	if (img->base_table[c])
+		return img->base_data + (size_t)(img->base_table[c] - 1) * HD_CLUSTER;
+	return img->zero;
+}
+
+//a table entry past the last stored cluster would point off the end
+static int hd_table_ok(const uint32_t *table, uint32_t clusters, uint32_t used)
+{
+	uint32_t c;
+
+	for (c = 0; c < clusters; c++)
+		if (table[c] > used)
+			return 0;
+	return 1;
+}
+
+static int hd_open_overlay(HdImage *img, const char *filename)
+{
+	HdHeader hdr;
+	struct stat st;
+	size_t data = hd_data_offset(img->hdr.clusters);
+	uint32_t c;
+
+	img->fd = open(filename, O_RDWR | O_CREAT, 0644);
+	if (img->fd < 0 || fstat(img->fd, &st) != 0)
+		return -1;
+	if (st.st_size == 0)
+	{
+		if (pwrite(img->fd, &img->hdr, sizeof(HdHeader), 0)
+			!= sizeof(HdHeader) || ftruncate(img->fd, data) != 0)
+			return -1;
+		return 0;
+	}
+
+	if (pread(img->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+		|| memcmp(hdr.magic, HD_MAGIC, sizeof(hdr.magic)) != 0
+		|| hdr.version != HD_VERSION
+		|| hdr.base_id != img->hdr.base_id
+		|| hdr.clusters != img->hdr.clusters)
+	{
+		fprintf(stderr, "%s is not an overlay of this disk\n", filename);
+		return -1;
+	}
+	img->hdr = hdr;
+	if (pread(img->fd, img->table, hdr.clusters * sizeof(uint32_t),
+		sizeof(HdHeader)) != (ssize_t)(hdr.clusters * sizeof(uint32_t)))
+		return -1;
+	if (!hd_table_ok(img->table, hdr.clusters, hdr.used))
+	{
+		fprintf(stderr, "%s has a damaged cluster table\n", filename);
+		return -1;
+	}
+	for (c = 0; c < hdr.clusters; c++)
+	{
+		if (img->table[c] == 0)
+			continue;
+		img->over[c] = malloc(HD_CLUSTER);
+		if (img->over[c] == NULL || pread(img->fd, img->over[c], HD_CLUSTER,
+			data + (size_t)(img->table[c] - 1) * HD_CLUSTER) != HD_CLUSTER)
+			return -1;
+	}
+	return 0;
+}
+
+/* base is a sparse or raw image and is never written.  overlay names the
+ * file that keeps this emulator's writes, created if it does not exist;
+ * NULL keeps them in memory only. */
+int hd_attach(X86Cpu *cpu, int drive, const char *base, const char *overlay)
+{
+	HdImage *img;
+	const HdHeader *hdr;
+	struct stat st;
+	void *map;
+	int fd, type;
+
+	if (drive < 0 || drive >= HD_DRIVES)
+		return -1;
+	fd = open(base, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "disk image %s not found!\n", base);
+		return -1;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hd_detach(cpu, drive);
+	img = &cpu->hdisk->drive[drive];
+	img->base = map;
+	img->base_size = st.st_size;
+	memcpy(img->hdr.magic, HD_MAGIC, sizeof(img->hdr.magic));
+	img->hdr.version = HD_VERSION;
+	img->hdr.sectors = HD_SECTORS;
+	img->hdr.id = hd_new_id();
+
+	hdr = map;
+	if ((size_t)st.st_size >= sizeof(HdHeader)
+		&& memcmp(hdr->magic, HD_MAGIC, sizeof(hdr->magic)) == 0)
+	{
+		if (hdr->version != HD_VERSION || hdr->base_id != 0
+			|| hdr->sectors != HD_SECTORS
+			|| hdr->clusters != hd_clusters(hdr->cylinders, hdr->heads)
+			|| (size_t)st.st_size < hd_data_offset(hdr->clusters)
+				+ (size_t)hdr->used * HD_CLUSTER
+			|| !hd_table_ok((const uint32_t *)(hdr + 1), hdr->clusters,
+				hdr->used))
+		{
+			fprintf(stderr, "%s is not a usable base image\n", base);
+			hd_detach(cpu, drive);
+			return -1;
+		}
+		img->hdr.cylinders = hdr->cylinders;
+		img->hdr.heads = hdr->heads;
+		img->hdr.base_id = hdr->id;
+		img->base_table = (const uint32_t *)(hdr + 1);
+		img->base_data = img->base + hd_data_offset(hdr->clusters);
+	}
+	else
+	{
+		type = hd_raw_type(st.st_size);
+		if (type < 0)
+		{
+			fprintf(stderr, "%s is not an XT drive image\n", base);
+			hd_detach(cpu, drive);
+			return -1;
+		}
+		img->hdr.cylinders = hd_types[type][0];
+		img->hdr.heads = hd_types[type][1];
+		//raw images have no id, their size has to do
+		img->hdr.base_id = st.st_size;
+	}
+	img->hdr.clusters = hd_clusters(img->hdr.cylinders, img->hdr.heads);
+
+	img->over = calloc(img->hdr.clusters, sizeof(uint8_t *));
+	img->table = calloc(img->hdr.clusters, sizeof(uint32_t));
+	img->zero = calloc(1, HD_CLUSTER);
+	if (img->over == NULL || img->table == NULL || img->zero == NULL
+		|| (overlay && hd_open_overlay(img, overlay) != 0))
+	{
+		hd_detach(cpu, drive);
+		return -1;
+	}
+	return 0;
+}
+
+void hd_detach(X86Cpu *cpu, int drive)
+{
+	HdImage *img;
+	uint32_t c;
+
+	if (drive < 0 || drive >= HD_DRIVES)
+		return;
+	img = &cpu->hdisk->drive[drive];
+	if (img->base == NULL)
+		return;
+	if (img->over)
+		for (c = 0; c < img->hdr.clusters; c++)
+			free(img->over[c]);
+	free(img->over);
+	free(img->table);
+	free(img->zero);
+	if (img->fd >= 0)
+		close(img->fd);
+	munmap((void *)img->base, img->base_size);
+	memset(img, 0, sizeof(HdImage));
+	img->fd = -1;
+}
+
+/* Sector lba, and in run how many sectors from it on lie next to each
+ * other in memory, so a long read can be handed over in one piece. */
+const uint8_t *hd_read(HdImage *img, uint32_t lba, uint32_t *run)
+{
+	uint32_t c = lba / HD_CLUSTER_SECTORS;
+	uint32_t n = HD_CLUSTER_SECTORS - lba % HD_CLUSTER_SECTORS;
+	const uint8_t *p;
+
+	if (lba >= hd_sectors(img))
+		return NULL;
+	p = hd_cluster(img, c) + lba % HD_CLUSTER_SECTORS * HD_SECTOR;
+	for (c++; c < img->hdr.clusters
+		&& hd_cluster(img, c) == p + (size_t)n * HD_SECTOR; c++)
+		n += HD_CLUSTER_SECTORS;
+	if (n > hd_sectors(img) - lba)
+		n = hd_sectors(img) - lba;
+	*run = n;
+	return p;
+}
+
+/* Sector lba in the overlay, the cluster copied up on first use.  A file
+ * backed overlay gets the cluster appended straight away; call hd_flush
+ * once the sector holds its new data. */
+uint8_t *hd_write(HdImage *img, uint32_t lba)
+{
+	uint32_t c = lba / HD_CLUSTER_SECTORS;
+	uint8_t *p;
+	size_t at;
+
+	if (lba >= hd_sectors(img))
+		return NULL;
+	if (img->over[c] == NULL)
+	{
+		p = malloc(HD_CLUSTER);
+		if (p == NULL)
+			return NULL;
+		memcpy(p, hd_cluster(img, c), HD_CLUSTER);
+		if (img->fd >= 0)
+		{
+			at = hd_data_offset(img->hdr.clusters)
+				+ (size_t)img->hdr.used * HD_CLUSTER;
+			img->hdr.used++;
+			img->table[c] = img->hdr.used;
+			if (pwrite(img->fd, p, HD_CLUSTER, at) != HD_CLUSTER
+				|| pwrite(img->fd, &img->table[c], sizeof(uint32_t),
+					sizeof(HdHeader) + c * sizeof(uint32_t))
+					!= sizeof(uint32_t)
+				|| pwrite(img->fd, &img->hdr, sizeof(HdHeader), 0)
+					!= sizeof(HdHeader))
+			{
+				img->hdr.used--;
+				img->table[c] = 0;
+				free(p);
+				return NULL;
+			}
+		}
+		img->over[c] = p;
+	}
+	return img->over[c] + lba % HD_CLUSTER_SECTORS * HD_SECTOR;
+}
+
+int hd_flush(HdImage *img, uint32_t lba)
+{
+	uint32_t c = lba / HD_CLUSTER_SECTORS;
+	size_t off = lba % HD_CLUSTER_SECTORS * HD_SECTOR;
+
+	if (img->fd < 0)
+		return 0;
+	if (pwrite(img->fd, img->over[c] + off, HD_SECTOR,
+		hd_data_offset(img->hdr.clusters)
+		+ (size_t)(img->table[c] - 1) * HD_CLUSTER + off) != HD_SECTOR)
+		return -1;
+	return 0;
+}
+
+/* Write a new sparse base: a copy of a raw image with its all-zero
+ * clusters left out, or a blank disk of the given type if raw is NULL. */
+int hd_make(const char *filename, const char *raw, int type)
+{
+	HdHeader hdr;
+	uint8_t buf[HD_CLUSTER], zero[HD_CLUSTER];
+	uint32_t *table = NULL, c;
+	uint8_t *src = NULL;
+	size_t size = 0;
+	struct stat st;
+	FILE *fp;
+	int fd, ok = 1;
+
+	if (raw)
+	{
+		fd = open(raw, O_RDONLY);
+		if (fd < 0)
+			return -1;
+		if (fstat(fd, &st) != 0 || (type = hd_raw_type(st.st_size)) < 0)
+		{
+			close(fd);
+			return -1;
+		}
+		size = st.st_size;
+		src = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (src == MAP_FAILED)
+			return -1;
+	}
+	else if (type < 0 || type >= HD_TYPES)
+		return -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, HD_MAGIC, sizeof(hdr.magic));
+	hdr.version = HD_VERSION;
+	hdr.cylinders = hd_types[type][0];
+	hdr.heads = hd_types[type][1];
+	hdr.sectors = HD_SECTORS;
+	hdr.clusters = hd_clusters(hdr.cylinders, hdr.heads);
+	hdr.id = hd_new_id();
+	memset(zero, 0, HD_CLUSTER);
+
+	table = calloc(hdr.clusters, sizeof(uint32_t));
+	fp = fopen(filename, "wb");
+	if (table == NULL || fp == NULL)
+		ok = 0;
+	for (c = 0; ok && src && c < hdr.clusters; c++)
+		if (memcmp(src + (size_t)c * HD_CLUSTER, zero,
+			size - (size_t)c * HD_CLUSTER < HD_CLUSTER
+			? size - (size_t)c * HD_CLUSTER : HD_CLUSTER) != 0)
+			table[c] = ++hdr.used;
+	if (ok)
+		ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+			&& fwrite(table, sizeof(uint32_t), hdr.clusters, fp)
+				== hdr.clusters
+			&& fwrite(zero, 1, hd_data_offset(hdr.clusters) - sizeof(hdr)
+				- hdr.clusters * sizeof(uint32_t), fp)
+				== hd_data_offset(hdr.clusters) - sizeof(hdr)
+				- hdr.clusters * sizeof(uint32_t);
+	for (c = 0; ok && c < hdr.clusters; c++)
+	{
+		if (table[c] == 0)
+			continue;
+		//the last cluster of a raw image may run past its end
+		memset(buf, 0, HD_CLUSTER);
+		memcpy(buf, src + (size_t)c * HD_CLUSTER,
+			size - (size_t)c * HD_CLUSTER < HD_CLUSTER
+			? size - (size_t)c * HD_CLUSTER : HD_CLUSTER);
+		ok = fwrite(buf, HD_CLUSTER, 1, fp) == 1;
+	}
+	if (fp && fclose(fp) != 0)
+		ok = 0;
+	if (src)
+		munmap(src, size);
+	free(table);
+	return ok ? 0 : -1;
+}
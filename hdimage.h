@@ -0,0 +1,82 @@
+#ifndef HDIMAGE_H
+#define HDIMAGE_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "intel8086.h"
+
+/* Hard disk images.  A disk is a read only base, mapped so every emulator
+ * on the host shares the one copy in the page cache, under a private
+ * overlay that takes all writes a cluster at a time.  The overlay is kept
+ * in memory and, if it has a file, written through to it.  Like a floppy's
+ * it is not part of a snapshot, nor rewound by stepping back.
+ *
+ * Both are in the same sparse format: a header, a table with a slot per
+ * cluster and then only the clusters that were ever stored, in the order
+ * they were.  Slot 0 is a cluster never stored, it reads from the base or
+ * as zeros.  A raw sector-for-sector file of one of the XT drive types
+ * works as a base too.  Files are in host byte order, like snapshots. */
+#define HD_DRIVES 2
+#define HD_SECTOR 512
+#define HD_SECTORS 17		//per track on every XT drive type
+#define HD_CLUSTER 4096
+#define HD_CLUSTER_SECTORS (HD_CLUSTER / HD_SECTOR)
+#define HD_MAGIC "ACRNDISK"
+#define HD_VERSION 1
+#define HD_TYPES 4
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint16_t cylinders;
+	uint8_t heads, sectors;
+	uint32_t clusters;	//in the whole disk
+	uint32_t used;		//stored after the table
+	uint64_t id;
+	uint64_t base_id;	//id of the base an overlay belongs on, else 0
+} HdHeader;
+
+typedef struct {
+	const uint8_t *base;	//NULL when no disk is attached
+	size_t base_size;
+	const uint32_t *base_table;	//NULL for a raw base
+	const uint8_t *base_data;
+	uint8_t **over;		//overlay clusters in memory
+	uint32_t *table;	//overlay file slots
+	HdHeader hdr;		//the overlay's
+	int fd;			//overlay file, -1 for memory only
+	uint8_t *zero;		//a cluster nobody wrote
+} HdImage;
+
+typedef struct HardDisk {
+	HdImage drive[HD_DRIVES];
+	int instant;		//no seek or rotation delays
+} HardDisk;
+
+//cylinders and heads of the drive types on the controller's jumpers
+extern const uint16_t hd_types[HD_TYPES][2];
+
+int hd_init(X86Cpu *cpu);
+void hd_free(X86Cpu *cpu);
+int hd_attach(X86Cpu *cpu, int drive, const char *base, const char *overlay);
+void hd_detach(X86Cpu *cpu, int drive);
+int hd_make(const char *filename, const char *raw, int type);
+uint32_t hd_sectors(HdImage *img);
+const uint8_t *hd_read(HdImage *img, uint32_t lba, uint32_t *run);
+uint8_t *hd_write(HdImage *img, uint32_t lba);
+int hd_flush(HdImage *img, uint32_t lba);
+
+#endif
@@ -1,16 +1,13 @@
 #include "5150emu.h"
 #include "opcode.h"
+#include "mem.h"
+#include "io.h"
+#include "sched.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
-//tracer enable/disable
-#define TRACE
-#ifdef TRACE
-#define DPRINTF()
-#else
-#define DPRINTF()
-#endif
 #define SET_PC(x) \
 	cpu->cs = x & 0xFFFF;\
 	cpu->ip = (x >> 4) & 0xFFFF;
@@ -23,30 +20,66 @@
  *
  *
  */
-int (*opcodes[0x100])(X86Cpu *);
+/* All state lives in X86Cpu and do_op() dispatches with a switch, so there are
+ * no globals and any number of cpus can run on different threads. */
 int undef_op(X86Cpu *cpu)
 {
 
-	fprintf(stderr,"Undefined opcode %x @ %x",cpu->ram[PC],PC);
+	//quiet runs, the batch runner and libacorn report the halt themselves
+	if (cpu->trace)
+		fprintf(stderr, "Undefined opcode %x @ %x\n", cpu->ram[PC], PC);
 	return 1;
 
 
 }
-void init_8086(X86Cpu *cpu)
+int init_8086(X86Cpu *cpu)
 {
-	int i;
-	for(i = 0; i < 0x100; i++)
-	{
-		opcodes[i] = undef_op;
-	}
-//	opcodes[0xEA] = jmpf;
-	
 	memset(cpu, 0, sizeof(X86Cpu));
 	cpu->ip = 0xFFF0;
 	cpu->cs = 0xF000;
 	cpu->sp = 0xFFFE;
-	cpu->ram = malloc(RAM_SIZE);
-	memset(cpu->ram, 0, RAM_SIZE);
+	cpu->ram = calloc(1, RAM_SIZE);
+	if (cpu->ram == NULL)
+		return -1;
+	if (mem_init(cpu) != 0)
+	{
+		free(cpu->ram);
+		return -1;
+	}
+	if (io_init(cpu) != 0)
+	{
+		mem_free(cpu);
+		free(cpu->ram);
+		return -1;
+	}
+	sched_init(cpu);
+	return 0;
+}
+
+//run quietly until halted or out of instructions, returns the number run
+uint64_t run_8086(X86Cpu *cpu, uint64_t instructions)
+{
+	uint64_t start = cpu->insns;
+
+	cpu->running = 1;
+	while (cpu->running && cpu->insns - start < instructions)
+		do_op(cpu);
+
+	return cpu->insns - start;
+}
+
+/* Run one time slice: stop once the cycle budget is spent, the cpu halts or
+ * the instruction count reaches limit.  Returns the cycles actually used. */
+uint64_t run_8086_slice(X86Cpu *cpu, uint64_t cycles, uint64_t limit)
+{
+	uint64_t start = cpu->cycles;
+
+	cpu->running = 1;
+	while (cpu->running && cpu->cycles - start < cycles
+		&& cpu->insns < limit)
+		do_op(cpu);
+
+	return cpu->cycles - start;
 }
 
 void print_registers(X86Cpu *cpu)
@@ -107,10 +140,65 @@ void SHL1(unsigned char tmp)
 
 
 
+//INTR line from the interrupt controller, level triggered
+void intr_8086(X86Cpu *cpu, int level)
+{
+	cpu->intr_line = level != 0;
+	intr_sync(cpu);
+}
+
+//for anything outside the core that sets FLAGS
+void intr_sync_8086(X86Cpu *cpu)
+{
+	intr_sync(cpu);
+}
+
+void nmi_8086(X86Cpu *cpu)
+{
+	cpu->pending |= PENDING_NMI;
+}
+
+/* Slow path of the pending check at each instruction boundary.  The shadow
+ * left by STI or a stack segment load holds everything off once, then NMI
+ * beats INTR, which also needs IF. */
+static void check_interrupts(X86Cpu *cpu)
+{
+	uint8_t vector;
+
+	if (cpu->pending & PENDING_SHADOW)
+	{
+		cpu->pending &= ~PENDING_SHADOW;
+		return;
+	}
+	if (cpu->pending & PENDING_NMI)
+	{
+		cpu->pending &= ~PENDING_NMI;
+		cpu->cycles += INT_CYCLES;
+		interrupt(cpu, 2);
+		return;
+	}
+	if ((cpu->pending & PENDING_INTR) && FLAG_TST(FLAGS_INT))
+	{
+		vector = cpu->intr_ack ? cpu->intr_ack(cpu) : 0xFF;
+		DPRINTF("IRQ vector %.2X ", vector);
+		cpu->cycles += INT_CYCLES;
+		interrupt(cpu, vector);
+	}
+}
+
 int do_op(X86Cpu *cpu) 
 {
-	uint8_t op = cpu->ram[PC];
-	switch (cpu->ram[PC])//cpu->ram[0xFFFF0])
+	uint8_t op;
+	if (cpu->cycles >= cpu->next_event)
+		sched_run(cpu);
+	if (cpu->pending)
+		check_interrupts(cpu);
+	cpu->insns++;
+	cpu->rep = 0;
+	cpu->seg_ovr = -1;
+decode:
+	op = cpu->ram[PC];
+	switch (op)//cpu->ram[0xFFFF0])
 	{
 //	case 0x32:
 //			printf("XOR");
@@ -137,15 +225,44 @@ int do_op(X86Cpu *cpu)
 		//	PC += 2;
 	//		break;	
 			
+	//Prefixes, 2 cycles each then decode the next byte
+	case 0x26: case 0x2E: case 0x36: case 0x3E:
+		cpu->seg_ovr = (op >> 3) & 3;
+		cpu->ip++;
+		cpu->cycles += 2;
+		goto decode;
+	case 0xF2: case 0xF3:
+		cpu->rep = op;
+		cpu->ip++;
+		cpu->cycles += 2;
+		goto decode;
+
+	case 0x06: case 0x0E: case 0x16: case 0x1E:
+	case 0x07: case 0x17: case 0x1F:
+		push_pop_sreg(cpu);
+		break;
+
 		//Jumps
 	case 0x70 ... 0x7F:	jcc(cpu);	break;
+
+	case 0x8E:			mov_sreg(cpu);	break;
 			
 	case 0x9E:			sahf(cpu);	break;	
 	case 0x9F: 			lahf(cpu); 	break;
 
 
+	case 0xA4 ... 0xA7:
+	case 0xAA ... 0xAF:	string_op(cpu, op);	break;
+
 	case 0xB0 ... 0xBF:	mov(cpu);	break;
 
+	case 0xCC ... 0xCE:	int_op(cpu);	break;
+	case 0xCF:			iret(cpu);	break;
+	case BIOS_TRAP_OP:	bios_trap_op(cpu);	break;
+
+	case 0xD4:			aam(cpu);	break;
+	case 0xD5:			aad(cpu);	break;
+
 	//	case 0xD0:
 			//all have 1 as constant
 			//middle 3 bits determine instruction
@@ -178,14 +295,38 @@ int do_op(X86Cpu *cpu)
 	//			PC +=2;
 		//	}else exit(1);
 	//		break;
+		case 0xE4 ... 0xE7:
+		case 0xEC ... 0xEF:
+			in_out(cpu);
+			break;
 		case 0xEA:
 			jmpf(cpu);
 			break;
+		case 0xF6: case 0xF7:
+			grp3(cpu);
+			break;
 		//Flags
 		case 0xFA:
-			printf("%.2x CLI ",op);
+			DPRINTF("%.2x CLI ",op);
 			clear_flag(cpu, FLAGS_INT);
+			intr_sync(cpu);
+			cpu->ip++;
+			cpu->cycles += 2;
+			break;
+		case 0xFB:
+			sti(cpu);
+			break;
+		case 0xFC:
+			DPRINTF("%.2x CLD ",op);
+			clear_flag(cpu, FLAGS_DF);
+			cpu->ip++;
+			cpu->cycles += 2;
+			break;
+		case 0xFD:
+			DPRINTF("%.2x STD ",op);
+			set_flag(cpu, FLAGS_DF);
 			cpu->ip++;
+			cpu->cycles += 2;
 			break;
 		default:
 			undef_op(cpu);
@@ -15,6 +15,13 @@
  * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <stdint.h>
+#include "pic8259.h"
+#include "pit8253.h"
+#include "dma8237.h"
+#include "ppi8255.h"
+#include "video.h"
+#include "fdc765.h"
+#include "hdc.h"
 
 typedef union {
 	struct {
@@ -24,8 +31,31 @@ typedef union {
 	uint16_t w;
 } ShortReg;	
 
+struct MemMap;
+struct IoMap;
+struct Kbd;
+struct Floppy;
+struct HardDisk;
+struct Dos;
+struct X86Cpu;
+
+//device timers, see sched.c
+#define SCHED_MAX 8
 typedef struct {
+	uint64_t when;
+	void (*fn)(struct X86Cpu *cpu);
+} SchedEvent;
+
+/* Reasons to look at the next instruction boundary.  do_op() tests the whole
+ * mask with one branch and only then sorts out which applies. */
+#define PENDING_INTR	0x01	//INTR line is high and IF lets it in
+#define PENDING_NMI	0x02
+#define PENDING_SHADOW	0x04	//after STI/MOV SS/POP SS, hold off one instruction
+
+typedef struct X86Cpu {
 	uint8_t *ram;
+	struct MemMap *mem;
+	struct IoMap *io;
 	uint32_t pc;
 
 	//registers
@@ -36,15 +66,53 @@ typedef struct {
 	uint16_t flags;	
 	uint16_t cs, ds, ss, es; 
 
-	int cycles;
+	//prefixes of the instruction being decoded
+	uint8_t rep;
+	int8_t seg_ovr;		//-1 or ES CS SS DS as 0-3
+
+	uint64_t cycles;
+	uint64_t next_event;	//earliest events[].when
+	SchedEvent events[SCHED_MAX];
+	uint32_t pending;
+	uint8_t intr_line;	//INTR as the PIC drives it, whatever IF says
+	//interrupt controller hands over the vector when INTR is acknowledged
+	uint8_t (*intr_ack)(struct X86Cpu *cpu);
+	//vectors serviced in C instead of by the ROM, a bit each
+	uint32_t hle[8];
+	Pic8259 pic;
+	Pit8253 pit;
+	Dma8237 dma;
+	Ppi8255 ppi;
+	//host input queue, see kbd.h
+	struct Kbd *kbd;
+	Video video;
+	//host framebuffer, see video.h
+	struct Display *display;
+	Fdc765 fdc;
+	//disk images, see floppy.h
+	struct Floppy *floppy;
+	Hdc hdc;
+	//fixed disk images, see hdimage.h
+	struct HardDisk *hdisk;
+	//program loaded without booting, see dos.h
+	struct Dos *dos;
 	int running;
+	int trace;
+	//instructions retired, used to replay up to an exact point
+	uint64_t insns;
 } X86Cpu;
 
 
-void init_8086(X86Cpu *cpu);
+int init_8086(X86Cpu *cpu);
 void print_registers(X86Cpu *cpu);
 void print_flags(X86Cpu *cpu);
 int do_op(X86Cpu *cpu);
+uint64_t run_8086(X86Cpu *cpu, uint64_t instructions);
+uint64_t run_8086_slice(X86Cpu *cpu, uint64_t cycles, uint64_t limit);
+void string_op(X86Cpu *cpu, uint8_t op);
+void intr_8086(X86Cpu *cpu, int level);
+void intr_sync_8086(X86Cpu *cpu);
+void nmi_8086(X86Cpu *cpu);
 
 #define RAM_SIZE 0x100000
 #if 0
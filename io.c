@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "io.h"
+
+static uint8_t unmapped_read(X86Cpu *cpu, uint16_t port)
+{
+	return 0xFF;
+}
+
+static void unmapped_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+}
+
+//the bus cycle pair an 8088 runs for a word IN or OUT
+static uint16_t split_read(X86Cpu *cpu, uint16_t port)
+{
+	return io_read8(cpu, port) | io_read8(cpu, port + 1) << 8;
+}
+
+static void split_write(X86Cpu *cpu, uint16_t port, uint16_t val)
+{
+	io_write8(cpu, port, val & 0xFF);
+	io_write8(cpu, port + 1, val >> 8);
+}
+
+static const IoHandler unmapped = {
+	unmapped_read, unmapped_write, split_read, split_write
+};
+
+int io_init(X86Cpu *cpu)
+{
+	uint32_t i;
+
+	cpu->io = malloc(sizeof(IoMap));
+	if (cpu->io == NULL)
+		return -1;
+	for (i = 0; i < IO_PORTS; i++)
+		cpu->io->port[i] = unmapped;
+	return 0;
+}
+
+void io_free(X86Cpu *cpu)
+{
+	free(cpu->io);
+	cpu->io = NULL;
+}
+
+//NULL members of handler keep the default for that access
+void io_register(X86Cpu *cpu, uint16_t start, uint32_t count,
+	const IoHandler *handler)
+{
+	IoHandler *p;
+	uint32_t i;
+
+	for (i = 0; i < count && start + i < IO_PORTS; i++)
+	{
+		p = &cpu->io->port[start + i];
+		*p = unmapped;
+		if (handler == NULL)
+			continue;
+		if (handler->read8)
+			p->read8 = handler->read8;
+		if (handler->write8)
+			p->write8 = handler->write8;
+		if (handler->read16)
+			p->read16 = handler->read16;
+		if (handler->write16)
+			p->write16 = handler->write16;
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef IO_H
+#define IO_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include "intel8086.h"
+
+/* 64K I/O ports, each with its own slot of handlers so IN and OUT are one
+ * table load and one indirect call.  Unclaimed ports read 0xFF and drop
+ * writes.  Word accesses go to the byte handlers of port and port+1 as the
+ * 8088 bus does, unless the device registers a word handler of its own. */
+#define IO_PORTS 0x10000
+
+typedef struct {
+	uint8_t (*read8)(X86Cpu *cpu, uint16_t port);
+	void (*write8)(X86Cpu *cpu, uint16_t port, uint8_t val);
+	uint16_t (*read16)(X86Cpu *cpu, uint16_t port);
+	void (*write16)(X86Cpu *cpu, uint16_t port, uint16_t val);
+} IoHandler;
+
+typedef struct IoMap {
+	IoHandler port[IO_PORTS];
+} IoMap;
+
+int io_init(X86Cpu *cpu);
+void io_free(X86Cpu *cpu);
+void io_register(X86Cpu *cpu, uint16_t start, uint32_t count,
+	const IoHandler *handler);
+
+static inline uint8_t io_read8(X86Cpu *cpu, uint16_t port)
+{
+	return cpu->io->port[port].read8(cpu, port);
+}
+
+static inline void io_write8(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	cpu->io->port[port].write8(cpu, port, val);
+}
+
+static inline uint16_t io_read16(X86Cpu *cpu, uint16_t port)
+{
+	return cpu->io->port[port].read16(cpu, port);
+}
+
+static inline void io_write16(X86Cpu *cpu, uint16_t port, uint16_t val)
+{
+	cpu->io->port[port].write16(cpu, port, val);
+}
+
+#endif
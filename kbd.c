@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kbd.h"
+#include "ppi8255.h"
+#include "sched.h"
+
+//next byte for the PPI: the reset reply, then due script codes, then the queue
+static void kbd_poll(X86Cpu *cpu)
+{
+	Kbd *kbd = cpu->kbd;
+	uint32_t tail;
+
+	if (ppi_kbd_ready(cpu))
+	{
+		if (cpu->ppi.kbd_reset)
+		{
+			cpu->ppi.kbd_reset = 0;
+			ppi_kbd_byte(cpu, 0xAA);
+		}
+		else if (kbd->script_pos < kbd->script_len
+			&& cpu->cycles >= kbd->script_due)
+		{
+			ppi_kbd_byte(cpu, kbd->script[kbd->script_pos++].code);
+			if (kbd->script_pos < kbd->script_len)
+				kbd->script_due = cpu->cycles
+					+ kbd->script[kbd->script_pos].delay;
+		}
+		else
+		{
+			tail = atomic_load_explicit(&kbd->tail, memory_order_relaxed);
+			if (tail != atomic_load_explicit(&kbd->head,
+				memory_order_acquire))
+			{
+				ppi_kbd_byte(cpu, kbd->buf[tail % KBD_QUEUE]);
+				atomic_store_explicit(&kbd->tail, tail + 1,
+					memory_order_release);
+			}
+		}
+	}
+	sched_at(cpu, SCHED_KBD, cpu->cycles + KBD_POLL_CYCLES);
+}
+
+int kbd_init(X86Cpu *cpu)
+{
+	cpu->kbd = calloc(1, sizeof(Kbd));
+	if (cpu->kbd == NULL)
+		return -1;
+	sched_register(cpu, SCHED_KBD, kbd_poll);
+	sched_at(cpu, SCHED_KBD, cpu->cycles + KBD_POLL_CYCLES);
+	return 0;
+}
+
+void kbd_free(X86Cpu *cpu)
+{
+	if (cpu->kbd)
+		free(cpu->kbd->script);
+	free(cpu->kbd);
+	cpu->kbd = NULL;
+}
+
+//returns -1 if the queue is full and the code was dropped
+int kbd_push(X86Cpu *cpu, uint8_t code)
+{
+	Kbd *kbd = cpu->kbd;
+	uint32_t head = atomic_load_explicit(&kbd->head, memory_order_relaxed);
+
+	if (head - atomic_load_explicit(&kbd->tail, memory_order_acquire)
+		>= KBD_QUEUE)
+		return -1;
+	kbd->buf[head % KBD_QUEUE] = code;
+	atomic_store_explicit(&kbd->head, head + 1, memory_order_release);
+	return 0;
+}
+
+/* Scripts are whitespace separated hex scan codes, +N waits N ms of
+ * emulated time before the next code and # starts a comment. */
+int kbd_load_script(X86Cpu *cpu, const char *filename)
+{
+	Kbd *kbd = cpu->kbd;
+	KbdScript *script = NULL, *tmp;
+	uint32_t len = 0, size = 0;
+	uint64_t delay = 0;
+	char tok[64], *end;
+	unsigned long val;
+	FILE *fp;
+	int c, wait;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "keyboard script %s not found!\n", filename);
+		return -1;
+	}
+	while (fscanf(fp, "%63s", tok) == 1)
+	{
+		if (tok[0] == '#')
+		{
+			while ((c = fgetc(fp)) != EOF && c != '\n')
+				;
+			continue;
+		}
+		wait = tok[0] == '+';
+		val = strtoul(tok + wait, &end, wait ? 10 : 16);
+		if (*end != '\0' || end == tok + wait || (!wait && val > 0xFF))
+		{
+			fprintf(stderr, "%s: bad keyboard script entry %s\n",
+				filename, tok);
+			free(script);
+			fclose(fp);
+			return -1;
+		}
+		if (wait)
+		{
+			delay += (uint64_t)val * KBD_CYCLES_PER_MS;
+			continue;
+		}
+		if (len == size)
+		{
+			size = size ? size * 2 : 64;
+			tmp = realloc(script, size * sizeof(KbdScript));
+			if (tmp == NULL)
+			{
+				free(script);
+				fclose(fp);
+				return -1;
+			}
+			script = tmp;
+		}
+		script[len].delay = delay;
+		script[len].code = val;
+		len++;
+		delay = 0;
+	}
+	fclose(fp);
+
+	free(kbd->script);
+	kbd->script = script;
+	kbd->script_len = len;
+	kbd->script_pos = 0;
+	if (len)
+		kbd->script_due = cpu->cycles + script[0].delay;
+	return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef KBD_H
+#define KBD_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include <stdatomic.h>
+#include "intel8086.h"
+
+/* Host side of the keyboard.  Any one host thread may kbd_push() scan codes
+ * while the cpu runs: the queue is a single producer, single consumer ring
+ * and the emulation thread only ever takes from it, never waits on it.  A
+ * script gives headless runs the same input on every run, since its codes
+ * are released by emulated time rather than host time. */
+#define KBD_QUEUE 256		//power of two
+#define KBD_CYCLES_PER_MS 4773
+//how often the keyboard looks for a new byte, about one serial frame
+#define KBD_POLL_CYCLES KBD_CYCLES_PER_MS
+
+typedef struct {
+	uint64_t delay;		//cycles after the previous code
+	uint8_t code;
+} KbdScript;
+
+typedef struct Kbd {
+	_Atomic uint32_t head;	//written by the host thread
+	_Atomic uint32_t tail;	//written by the emulation thread
+	uint8_t buf[KBD_QUEUE];
+	KbdScript *script;
+	uint32_t script_len, script_pos;
+	uint64_t script_due;
+} Kbd;
+
+int kbd_init(X86Cpu *cpu);
+void kbd_free(X86Cpu *cpu);
+int kbd_push(X86Cpu *cpu, uint8_t code);
+int kbd_load_script(X86Cpu *cpu, const char *filename);
+
+#endif
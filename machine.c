@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "5150emu.h"
+#include "snapshot.h"
+#include "mem.h"
+#include "io.h"
+#include "pic8259.h"
+#include "pit8253.h"
+#include "dma8237.h"
+#include "ppi8255.h"
+#include "kbd.h"
+#include "fdc765.h"
+#include "floppy.h"
+#include "hdc.h"
+#include "hdimage.h"
+#include "dos.h"
+
+/* Machine level setup shared by the B8086 driver, the batch runner and
+ * libacorn.  Nothing in here touches globals. */
+X86Cpu *machine_create(void)
+{
+	X86Cpu *cpu;
+
+	cpu = malloc(sizeof(X86Cpu));
+	if (cpu == NULL)
+		return NULL;
+	if (init_8086(cpu) != 0)
+	{
+		free(cpu);
+		return NULL;
+	}
+	mem_map(cpu, BIOS_ADDR, BIOS_SIZE, MEM_ROM, NULL);
+	pic_init(cpu);
+	pit_init(cpu);
+	dma_init(cpu);
+	ppi_init(cpu);
+	fdc_init(cpu);
+	hdc_init(cpu);
+	if (kbd_init(cpu) != 0 || video_init(cpu) != 0
+		|| floppy_init(cpu) != 0 || hd_init(cpu) != 0
+		|| dos_init(cpu) != 0)
+	{
+		machine_destroy(cpu);
+		return NULL;
+	}
+	return cpu;
+}
+
+void machine_destroy(X86Cpu *cpu)
+{
+	if (cpu == NULL)
+		return;
+	dos_free(cpu);
+	hd_free(cpu);
+	floppy_free(cpu);
+	video_free(cpu);
+	kbd_free(cpu);
+	io_free(cpu);
+	mem_free(cpu);
+	free(cpu->ram);
+	free(cpu);
+}
+
+/* Fast boot: POST already knows how to skip its memory tests, it does so on
+ * a ctrl-alt-del when the reset flag at 0040:0072 reads 1234h.  Each known
+ * ROM gets its warm boot branches turned into plain jumps so a cold start
+ * takes the same path, plus a fix to the checksum byte so the ROS test
+ * still passes.  A patch is only applied if every original byte matches. */
+typedef struct {
+	uint16_t offset;
+	uint8_t from, to;
+} RomPatch;
+
+typedef struct {
+	const char *part;	//part number at F000:E000
+	const char *date;	//release date at F000:FFF5
+	int count;
+	RomPatch patch[8];
+} RomFix;
+
+static const RomFix rom_fixes[] = {
+	{ "1501476", "10/27/82", 4, {
+		{ 0xE159, 0x74, 0xEB },	//first 16K storage test
+		{ 0xE315, 0x74, 0xEB },	//video buffer test
+		{ 0xE3EA, 0x74, 0xEB },	//storage above 16K
+		{ 0xFFFF, 0x78, 0x13 },	//E000-FFFF sums to 0 again
+	} },
+};
+
+int fast_boot(X86Cpu *cpu)
+{
+	uint8_t *rom = &cpu->ram[BIOS_ADDR];
+	const RomFix *fix;
+	size_t i;
+	int j, ok, done;
+
+	for (i = 0; i < sizeof(rom_fixes) / sizeof(rom_fixes[0]); i++)
+	{
+		fix = &rom_fixes[i];
+		if (memcmp(&rom[0xE000], fix->part, strlen(fix->part)) != 0
+			|| memcmp(&rom[0xFFF5], fix->date, 8) != 0)
+			continue;
+		ok = done = 1;
+		for (j = 0; j < fix->count; j++)
+		{
+			ok &= rom[fix->patch[j].offset] == fix->patch[j].from;
+			done &= rom[fix->patch[j].offset] == fix->patch[j].to;
+		}
+		if (done)
+			return 0;
+		if (!ok)
+			break;
+		for (j = 0; j < fix->count; j++)
+			rom[fix->patch[j].offset] = fix->patch[j].to;
+		return 0;
+	}
+	fprintf(stderr, "no fast boot patches for this BIOS\n");
+	return -1;
+}
+
+int load_bios(X86Cpu *cpu, char *filename)
+{
+	FILE *bios;
+	uint8_t *tmp;
+	bios = fopen(filename,"rb");
+
+	if (bios == NULL)
+	{
+		fprintf(stderr, "BIOS %s not found!\n",filename);
+		return -1;
+	}
+
+	tmp = malloc(BIOS_SIZE);
+	if (tmp == NULL)
+	{
+		fclose(bios);
+		return -1;
+	}
+	memset(tmp, 0xFF, BIOS_SIZE);
+	fread(tmp, 1, BIOS_SIZE, bios);
+	fclose(bios);
+	memcpy(&cpu->ram[BIOS_ADDR], tmp, BIOS_SIZE);
+	if (cpu->trace)
+		printf("%x\n", tmp[0]);
+	free(tmp);
+
+	return 0;
+}
+
+//snapshots carry their own registers, anything else is a BIOS ROM
+int load_image(X86Cpu *cpu, char *filename)
+{
+	if (snapshot_is_file(filename))
+	{
+		if (snapshot_load(cpu, filename) != 0)
+		{
+			fprintf(stderr, "snapshot %s is damaged or from another build\n",
+				filename);
+			return -1;
+		}
+		return 0;
+	}
+
+	return load_bios(cpu, filename);
+}
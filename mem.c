@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int mem_init(X86Cpu *cpu)
+{
+	cpu->mem = calloc(1, sizeof(MemMap));
+	if (cpu->mem == NULL)
+		return -1;
+	return 0;
+}
+
+void mem_free(X86Cpu *cpu)
+{
+	free(cpu->mem);
+	cpu->mem = NULL;
+}
+
+//start and len are rounded out to whole pages
+void mem_map(X86Cpu *cpu, uint32_t start, uint32_t len, int type,
+	const MemHandler *handler)
+{
+	uint32_t page;
+
+	for (page = start >> MEM_PAGE_SHIFT;
+		page < MEM_PAGES && page << MEM_PAGE_SHIFT < start + len; page++)
+	{
+		cpu->mem->type[page] = type;
+		cpu->mem->mmio[page] = type == MEM_MMIO ? handler : NULL;
+	}
+}
+
+/* True if [start, start+len) doesn't wrap at 1MB and is all RAM, or for
+ * reads RAM or ROM, so it can be touched straight through cpu->ram.  Watched
+ * RAM counts as RAM; whoever writes it directly must call mem_dirty(). */
+int mem_range_is(X86Cpu *cpu, uint32_t start, uint32_t len, int writable)
+{
+	uint32_t page, last;
+	uint8_t type;
+
+	if (len == 0)
+		return 1;
+	if (start >= RAM_SIZE || len > RAM_SIZE - start)
+		return 0;
+
+	last = (start + len - 1) >> MEM_PAGE_SHIFT;
+	for (page = start >> MEM_PAGE_SHIFT; page <= last; page++)
+	{
+		type = cpu->mem->type[page];
+		if (type == MEM_MMIO || (writable && type == MEM_ROM))
+			return 0;
+	}
+	return 1;
+}
+
+uint8_t mem_mmio_read(X86Cpu *cpu, uint32_t addr)
+{
+	const MemHandler *h = cpu->mem->mmio[addr >> MEM_PAGE_SHIFT];
+
+	if (h == NULL || h->read == NULL)
+		return 0xFF;
+	return h->read(cpu, addr);
+}
+
+void mem_mmio_write(X86Cpu *cpu, uint32_t addr, uint8_t val)
+{
+	const MemHandler *h = cpu->mem->mmio[addr >> MEM_PAGE_SHIFT];
+
+	if (h && h->write)
+		h->write(cpu, addr, val);
+}
+
+//record a direct write to cpu->ram, only watched pages keep track
+void mem_dirty(X86Cpu *cpu, uint32_t start, uint32_t len)
+{
+	uint32_t page, addr, end;
+
+	if (len == 0)
+		return;
+	end = start + len > RAM_SIZE ? RAM_SIZE : start + len;
+	for (page = start >> MEM_PAGE_SHIFT; page << MEM_PAGE_SHIFT < end; page++)
+	{
+		if (cpu->mem->type[page] != MEM_WATCH)
+			continue;
+		addr = page << MEM_PAGE_SHIFT;
+		if (addr < start)
+			addr = start;
+		addr &= ~((1 << MEM_DIRTY_SHIFT) - 1);
+		for (; addr < end && addr >> MEM_PAGE_SHIFT == page;
+			addr += 1 << MEM_DIRTY_SHIFT)
+			mem_mark(cpu, addr);
+	}
+}
+
+/* Copy out and clear the dirty bits of a watched range.  start and len must
+ * be multiples of 128 bytes, one bits word; bits gets len / 128 words.
+ * Returns 0 without touching bits when no page in the range was written,
+ * which is what makes an idle screen free. */
+int mem_take_dirty(X86Cpu *cpu, uint32_t start, uint32_t len, uint64_t *bits)
+{
+	MemMap *mem = cpu->mem;
+	uint32_t page, first, last, i, word;
+	int any = 0;
+
+	first = start >> MEM_PAGE_SHIFT;
+	last = (start + len - 1) >> MEM_PAGE_SHIFT;
+	for (page = first; page <= last; page++)
+		any |= mem->page_dirty[page];
+	if (!any)
+		return 0;
+
+	word = start >> (MEM_DIRTY_SHIFT + 6);
+	for (i = 0; i < len >> (MEM_DIRTY_SHIFT + 6); i++)
+	{
+		bits[i] = mem->dirty[word + i];
+		mem->dirty[word + i] = 0;
+	}
+	for (page = first; page <= last; page++)
+		mem->page_dirty[page] = 0;
+	return 1;
+}
@@ -0,0 +1,106 @@
+#ifndef MEM_H
+#define MEM_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include "intel8086.h"
+
+/* The 1MB address space is split into 4K pages, each plain RAM, ROM (writes
+ * dropped), MMIO (every access goes to a device) or watched RAM, which is
+ * RAM that also records which words were written so a device such as the
+ * video card only looks at what changed.  Guest data accesses go through
+ * mem_read8/mem_write8; bulk paths check a whole range once with
+ * mem_range_is(), work on cpu->ram directly and then report what they
+ * wrote with mem_dirty(). */
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGES (RAM_SIZE >> MEM_PAGE_SHIFT)
+#define MEM_MASK (RAM_SIZE - 1)
+//watched pages are tracked per word, a text cell
+#define MEM_DIRTY_SHIFT 1
+
+enum { MEM_RAM, MEM_ROM, MEM_MMIO, MEM_WATCH };
+
+typedef struct {
+	uint8_t (*read)(X86Cpu *cpu, uint32_t addr);
+	void (*write)(X86Cpu *cpu, uint32_t addr, uint8_t val);
+} MemHandler;
+
+typedef struct MemMap {
+	uint8_t type[MEM_PAGES];
+	const MemHandler *mmio[MEM_PAGES];
+	//watched pages with any bit set below
+	uint8_t page_dirty[MEM_PAGES];
+	uint64_t dirty[RAM_SIZE >> (MEM_DIRTY_SHIFT + 6)];
+} MemMap;
+
+int mem_init(X86Cpu *cpu);
+void mem_free(X86Cpu *cpu);
+void mem_map(X86Cpu *cpu, uint32_t start, uint32_t len, int type,
+	const MemHandler *handler);
+int mem_range_is(X86Cpu *cpu, uint32_t start, uint32_t len, int writable);
+uint8_t mem_mmio_read(X86Cpu *cpu, uint32_t addr);
+void mem_mmio_write(X86Cpu *cpu, uint32_t addr, uint8_t val);
+void mem_dirty(X86Cpu *cpu, uint32_t start, uint32_t len);
+int mem_take_dirty(X86Cpu *cpu, uint32_t start, uint32_t len, uint64_t *bits);
+
+static inline void mem_mark(X86Cpu *cpu, uint32_t addr)
+{
+	uint32_t unit = addr >> MEM_DIRTY_SHIFT;
+
+	cpu->mem->dirty[unit >> 6] |= 1ULL << (unit & 63);
+	cpu->mem->page_dirty[addr >> MEM_PAGE_SHIFT] = 1;
+}
+
+static inline uint8_t mem_read8(X86Cpu *cpu, uint32_t addr)
+{
+	addr &= MEM_MASK;
+	if (cpu->mem->type[addr >> MEM_PAGE_SHIFT] == MEM_MMIO)
+		return mem_mmio_read(cpu, addr);
+	return cpu->ram[addr];
+}
+
+static inline void mem_write8(X86Cpu *cpu, uint32_t addr, uint8_t val)
+{
+	addr &= MEM_MASK;
+	switch (cpu->mem->type[addr >> MEM_PAGE_SHIFT])
+	{
+		case MEM_RAM:
+			cpu->ram[addr] = val;
+			break;
+		case MEM_MMIO:
+			mem_mmio_write(cpu, addr, val);
+			break;
+		case MEM_WATCH:
+			cpu->ram[addr] = val;
+			mem_mark(cpu, addr);
+			break;
+	}
+}
+
+//segment:offset word access, the offset wraps inside the segment
+static inline uint16_t mem_read16(X86Cpu *cpu, uint16_t seg, uint16_t off)
+{
+	return mem_read8(cpu, (seg << 4) + off)
+		| mem_read8(cpu, (seg << 4) + (uint16_t)(off + 1)) << 8;
+}
+
+static inline void mem_write16(X86Cpu *cpu, uint16_t seg, uint16_t off,
+	uint16_t val)
+{
+	mem_write8(cpu, (seg << 4) + off, val & 0xFF);
+	mem_write8(cpu, (seg << 4) + (uint16_t)(off + 1), val >> 8);
+}
+
+#endif
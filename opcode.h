@@ -1,15 +1,23 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "intel8086.h"
+#include "mem.h"
+#include "io.h"
+#include "bios.h"
 #define FLAGS_CF	0x001
 #define FLAGS_PF 	0x004
+#define FLAGS_AF 	0x010
 #define FLAGS_ZF 	0x040
 #define FLAGS_SF	0x080
+#define FLAGS_TF 	0x100
 #define FLAGS_INT 	0x200
+#define FLAGS_DF 	0x400
 #define FLAGS_OV    0x800
 #define FLAG_TST(x)    ((x & cpu->flags) != 0)
-#define PC (cpu->ip | (cpu->cs << 4))
+#define PC (((cpu->cs << 4) + cpu->ip) & 0xFFFFF)
 #define RAM_IMM cpu->ram[PC+1]
+//instruction trace, off while replaying or running headless
+#define DPRINTF(...) do { if (cpu->trace) printf(__VA_ARGS__); } while (0)
 static inline void jmpf(X86Cpu *cpu)
 {
 	uint32_t new_cs;
@@ -18,7 +26,8 @@ static inline void jmpf(X86Cpu *cpu)
 	new_ip = (cpu->ram[PC+2] << 8) + cpu->ram[PC+1];
 	cpu->cs = new_cs;
 	cpu->ip = new_ip;
-	printf("JMP Direct to $0x%.6X", PC);
+	cpu->cycles += 15;
+	DPRINTF("JMP Direct to $0x%.6X", PC);
 }
 
 static inline void set_flag(X86Cpu *cpu, uint16_t flag)
@@ -56,10 +65,68 @@ static inline void chk_zero(X86Cpu *cpu, unsigned short data)
 	
 
 }
+static inline void put_flag(X86Cpu *cpu, uint16_t flag, int on)
+{
+	if (on)
+		set_flag(cpu, flag);
+	else
+		clear_flag(cpu, flag);
+}
+
+//flags for a - b, as CMP/SUB/CMPS/SCAS leave them; PF is the low byte only
+static inline void flags_sub(X86Cpu *cpu, uint16_t a, uint16_t b, int word)
+{
+	uint32_t res = (uint32_t)a - b;
+	uint16_t sign = word ? 0x8000 : 0x80;
+	uint16_t mask = word ? 0xFFFF : 0xFF;
+
+	put_flag(cpu, FLAGS_CF, res & (mask + 1));
+	put_flag(cpu, FLAGS_AF, (a ^ b ^ res) & 0x10);
+	put_flag(cpu, FLAGS_OV, (a ^ b) & (a ^ res) & sign);
+	put_flag(cpu, FLAGS_SF, res & sign);
+	chk_zero(cpu, res & mask);
+	chk_parity(cpu, res & 0xFF);
+}
+
+//ES CS SS DS in sreg encoding order
+static inline uint16_t *sreg(X86Cpu *cpu, int reg)
+{
+	switch (reg & 3)
+	{
+		case 0: return &cpu->es;
+		case 1: return &cpu->cs;
+		case 2: return &cpu->ss;
+		default: return &cpu->ds;
+	}
+}
+
+/* IF changed: INTR only counts as pending while IF would let it in, so a
+ * CLI section with an IRQ waiting stays on the fast path. */
+static inline void intr_sync(X86Cpu *cpu)
+{
+	if (cpu->intr_line && FLAG_TST(FLAGS_INT))
+		cpu->pending |= PENDING_INTR;
+	else
+		cpu->pending &= ~PENDING_INTR;
+}
+
+//an interrupt would be taken at the next instruction boundary
+static inline int intr_ready(X86Cpu *cpu)
+{
+	return (cpu->pending & PENDING_NMI)
+		|| ((cpu->pending & PENDING_INTR) && FLAG_TST(FLAGS_INT));
+}
+
+//segment for a data access, honouring any override prefix
+static inline uint16_t data_seg(X86Cpu *cpu, uint16_t def)
+{
+	return cpu->seg_ovr < 0 ? def : *sreg(cpu, cpu->seg_ovr);
+}
+
 /* 0x70 - 0x7F */
 static inline void jcc(X86Cpu *cpu)
 {
-	fprintf(stderr,"Jcc %x",cpu->ram[PC]);
+	DPRINTF("Jcc %x",cpu->ram[PC]);
 	bool test;
 	switch(cpu->ram[PC] & 0xF)
 	{	
@@ -83,7 +150,12 @@ static inline void jcc(X86Cpu *cpu)
 
 
 	if(test)
-		cpu->ip += RAM_IMM;
+	{
+		cpu->ip += (int8_t)RAM_IMM;
+		cpu->cycles += 16;
+	}
+	else
+		cpu->cycles += 4;
 		
 	cpu->ip +=2;
 }
@@ -92,41 +164,507 @@ static inline void jcc(X86Cpu *cpu)
 //9e
 static inline void sahf(X86Cpu *cpu)
 {
-	printf("SAHF");
+	DPRINTF("SAHF");
 	cpu->flags = (cpu->flags & 0xF00) + cpu->ax.h;
 	if(FLAG_TST(FLAGS_CF) ^ FLAG_TST(FLAGS_SF))
 	{
 		set_flag(cpu,FLAGS_OV);
 	}
 	cpu->ip++;
+	cpu->cycles += 4;
 }
 //9f
 static inline void lahf(X86Cpu *cpu)
 {
-	printf("LAHF");
+	DPRINTF("LAHF");
 	cpu->ax.h = (cpu->flags & 0xFF);
 	cpu->ip++;
+	cpu->cycles += 4;
+}
+
+//register fields in opcode order: AL CL DL BL AH CH DH BH
+static inline uint8_t *reg8(X86Cpu *cpu, int reg)
+{
+	ShortReg *r;
+
+	switch (reg & 3)
+	{
+		case 0: r = &cpu->ax; break;
+		case 1: r = &cpu->cx; break;
+		case 2: r = &cpu->dx; break;
+		default: r = &cpu->bx; break;
+	}
+	return (reg & 4) ? &r->h : &r->l;
+}
+
+//AX CX DX BX SP BP SI DI
+static inline uint16_t *reg16(X86Cpu *cpu, int reg)
+{
+	switch (reg & 7)
+	{
+		case 0: return &cpu->ax.w;
+		case 1: return &cpu->cx.w;
+		case 2: return &cpu->dx.w;
+		case 3: return &cpu->bx.w;
+		case 4: return &cpu->sp;
+		case 5: return &cpu->bp;
+		case 6: return &cpu->si;
+		default: return &cpu->di;
+	}
 }
 
 /* 0xB0 - 0xBF */
 static inline void mov(X86Cpu *cpu)
 {
 	uint8_t tmp = cpu->ram[PC] & 0xF;
-	fprintf(stderr,"%x %x MOV",cpu->ram[PC],cpu->ram[PC+1] );
-	switch(tmp)
+	DPRINTF("%x %x MOV",cpu->ram[PC],cpu->ram[PC+1] );
+	if (tmp & 0x8)
+	{
+		*reg16(cpu, tmp) = (cpu->ram[PC+2] << 8) + RAM_IMM;
+		cpu->ip += 3;
+	}
+	else
+	{
+		*reg8(cpu, tmp) = RAM_IMM;
+		cpu->ip += 2;
+	}
+	cpu->cycles += 4;
+}
+
+//stack, always SS:SP
+static inline void push16(X86Cpu *cpu, uint16_t val)
+{
+	cpu->sp -= 2;
+	mem_write16(cpu, cpu->ss, cpu->sp, val);
+}
+
+static inline uint16_t pop16(X86Cpu *cpu)
+{
+	uint16_t val = mem_read16(cpu, cpu->ss, cpu->sp);
+	cpu->sp += 2;
+	return val;
+}
+
+/* Enter an interrupt handler through the IVT at 0000:0000.  IP must already
+ * be the return address.  Vectors trapped for HLE may be serviced here and
+ * now instead, see bios.h. */
+static inline void interrupt(X86Cpu *cpu, uint8_t vector)
+{
+	if ((cpu->hle[vector >> 5] >> (vector & 31) & 1) && bios_hle(cpu, vector))
+		return;
+	push16(cpu, cpu->flags);
+	clear_flag(cpu, FLAGS_INT | FLAGS_TF);
+	intr_sync(cpu);
+	push16(cpu, cpu->cs);
+	push16(cpu, cpu->ip);
+	cpu->ip = mem_read16(cpu, 0, vector * 4);
+	cpu->cs = mem_read16(cpu, 0, vector * 4 + 2);
+}
+
+/* ModR/M operand.  For memory operands seg:off is the effective address and
+ * ea the 8086 EA calculation cycles. */
+typedef struct {
+	uint8_t mod, reg, rm;
+	uint16_t seg, off;
+	uint8_t len;		//ModR/M byte plus displacement
+	uint8_t ea;
+} ModRM;
+
+//decodes the ModR/M byte following the opcode at PC
+static inline void modrm(X86Cpu *cpu, ModRM *m)
+{
+	//BX+SI BX+DI BP+SI BP+DI SI DI BP BX
+	static const uint8_t ea_cycles[8] = { 7, 8, 8, 7, 5, 5, 5, 5 };
+	uint8_t b = cpu->ram[PC+1];
+	uint16_t disp = 0;
+	uint16_t def = cpu->ds;
+
+	m->mod = b >> 6;
+	m->reg = (b >> 3) & 7;
+	m->rm = b & 7;
+	m->len = 1;
+	m->ea = 0;
+	if (m->mod == 3)
+		return;
+
+	if (m->mod == 1)
+	{
+		disp = (int8_t)cpu->ram[PC+2];
+		m->len = 2;
+	}
+	else if (m->mod == 2 || (m->mod == 0 && m->rm == 6))
+	{
+		disp = cpu->ram[PC+2] | cpu->ram[PC+3] << 8;
+		m->len = 3;
+	}
+
+	if (m->mod == 0 && m->rm == 6)
+	{
+		m->off = disp;
+		m->ea = 6;
+	}
+	else
+	{
+		switch (m->rm)
+		{
+			case 0: m->off = cpu->bx.w + cpu->si; break;
+			case 1: m->off = cpu->bx.w + cpu->di; break;
+			case 2: m->off = cpu->bp + cpu->si; def = cpu->ss; break;
+			case 3: m->off = cpu->bp + cpu->di; def = cpu->ss; break;
+			case 4: m->off = cpu->si; break;
+			case 5: m->off = cpu->di; break;
+			case 6: m->off = cpu->bp; def = cpu->ss; break;
+			default: m->off = cpu->bx.w; break;
+		}
+		m->off += disp;
+		m->ea = ea_cycles[m->rm] + (m->mod ? 4 : 0);
+	}
+	m->seg = data_seg(cpu, def);
+	if (cpu->seg_ovr >= 0)
+		m->ea += 2;
+}
+
+static inline uint8_t rm_read8(X86Cpu *cpu, ModRM *m)
+{
+	if (m->mod == 3)
+		return *reg8(cpu, m->rm);
+	return mem_read8(cpu, (m->seg << 4) + m->off);
+}
+
+static inline uint16_t rm_read16(X86Cpu *cpu, ModRM *m)
+{
+	if (m->mod == 3)
+		return *reg16(cpu, m->rm);
+	return mem_read16(cpu, m->seg, m->off);
+}
+
+/* MUL/IMUL/DIV/IDIV take longer the more 1 bits the microcode loop meets:
+ * the multiplier for MUL, the quotient for DIV.  Spread the popcount over
+ * the documented min-max range instead of stepping bit by bit. */
+static inline int span_cycles(int min, int max, uint32_t bits, int width)
+{
+	return min + (max - min) * __builtin_popcount(bits) / width;
+}
+
+//8088 cost of the push/vector sequence, INT n and hardware interrupts alike
+#define INT_CYCLES 71
+
+//divide error, the 8086 pushes the address of the next instruction
+static inline void divide_error(X86Cpu *cpu)
+{
+	DPRINTF(" divide error");
+	cpu->cycles += INT_CYCLES;
+	interrupt(cpu, 0);
+}
+
+/* 0xF6, 0xF7 /4-/7: MUL IMUL DIV IDIV, 8088 timings */
+static inline void grp3(X86Cpu *cpu)
+{
+	int word = cpu->ram[PC] & 1;
+	ModRM m;
+	uint32_t src, ua, q, r;
+	int32_t sa, ss, sq, sr;
+	int extra;
+
+	modrm(cpu, &m);
+	if (m.reg < 4)
+	{
+		fprintf(stderr, "unhandled grp3 /%d", m.reg);
+		cpu->running = 0;
+		return;
+	}
+	src = word ? rm_read16(cpu, &m) : rm_read8(cpu, &m);
+	//memory operand: EA, the fetch, and the second byte of a word on the 8088
+	extra = m.mod == 3 ? 0 : m.ea + 6 + (word ? 4 : 0);
+	cpu->ip += 1 + m.len;
+	cpu->cycles += extra;
+
+	switch (m.reg)
 	{
-		case 0x4:
-			cpu->ax.h = RAM_IMM; 
+		case 4:
+			DPRINTF("MUL");
+			if (word)
+			{
+				ua = (uint32_t)cpu->ax.w * src;
+				cpu->ax.w = ua;
+				cpu->dx.w = ua >> 16;
+				put_flag(cpu, FLAGS_CF | FLAGS_OV, cpu->dx.w != 0);
+				cpu->cycles += span_cycles(118, 133, src, 16);
+			}
+			else
+			{
+				cpu->ax.w = cpu->ax.l * src;
+				put_flag(cpu, FLAGS_CF | FLAGS_OV, cpu->ax.h != 0);
+				cpu->cycles += span_cycles(70, 77, src, 8);
+			}
+			break;
+		case 5:
+			DPRINTF("IMUL");
+			if (word)
+			{
+				ss = (int16_t)src;
+				sa = (int16_t)cpu->ax.w * ss;
+				cpu->ax.w = sa;
+				cpu->dx.w = (uint32_t)sa >> 16;
+				put_flag(cpu, FLAGS_CF | FLAGS_OV, sa != (int16_t)sa);
+				cpu->cycles += span_cycles(128, 154, ss < 0 ? -ss : ss, 16);
+			}
+			else
+			{
+				ss = (int8_t)src;
+				sa = (int8_t)cpu->ax.l * ss;
+				cpu->ax.w = sa;
+				put_flag(cpu, FLAGS_CF | FLAGS_OV, sa != (int8_t)sa);
+				cpu->cycles += span_cycles(80, 98, ss < 0 ? -ss : ss, 8);
+			}
+			break;
+		case 6:
+			DPRINTF("DIV");
+			if (word)
+			{
+				ua = (uint32_t)cpu->dx.w << 16 | cpu->ax.w;
+				if (src == 0 || ua / src > 0xFFFF)
+				{
+					divide_error(cpu);
+					break;
+				}
+				q = ua / src;
+				r = ua % src;
+				cpu->ax.w = q;
+				cpu->dx.w = r;
+				cpu->cycles += span_cycles(144, 162, q, 16);
+			}
+			else
+			{
+				ua = cpu->ax.w;
+				if (src == 0 || ua / src > 0xFF)
+				{
+					divide_error(cpu);
+					break;
+				}
+				q = ua / src;
+				r = ua % src;
+				cpu->ax.l = q;
+				cpu->ax.h = r;
+				cpu->cycles += span_cycles(80, 90, q, 8);
+			}
 			break;
+		case 7:
+			//the 8086 also faults on the most negative quotient
+			DPRINTF("IDIV");
+			if (word)
+			{
+				sa = (int32_t)((uint32_t)cpu->dx.w << 16 | cpu->ax.w);
+				ss = (int16_t)src;
+				if (ss == 0 || (sa == INT32_MIN && ss == -1))
+				{
+					divide_error(cpu);
+					break;
+				}
+				sq = sa / ss;
+				sr = sa % ss;
+				if (sq > 0x7FFF || sq < -0x7FFF)
+				{
+					divide_error(cpu);
+					break;
+				}
+				cpu->ax.w = sq;
+				cpu->dx.w = sr;
+				cpu->cycles += span_cycles(165, 184, sq < 0 ? -sq : sq, 16);
+			}
+			else
+			{
+				sa = (int16_t)cpu->ax.w;
+				ss = (int8_t)src;
+				if (ss == 0)
+				{
+					divide_error(cpu);
+					break;
+				}
+				sq = sa / ss;
+				sr = sa % ss;
+				if (sq > 0x7F || sq < -0x7F)
+				{
+					divide_error(cpu);
+					break;
+				}
+				cpu->ax.l = sq;
+				cpu->ax.h = sr;
+				cpu->cycles += span_cycles(101, 112, sq < 0 ? -sq : sq, 8);
+			}
+			break;
+	}
+}
+
+static inline void flags_szp8(X86Cpu *cpu, uint8_t val)
+{
+	put_flag(cpu, FLAGS_SF, val & 0x80);
+	chk_zero(cpu, val);
+	chk_parity(cpu, val);
+}
+
+/* 0xD4 AAM, the immediate is the base (0x0A as documented) */
+static inline void aam(X86Cpu *cpu)
+{
+	uint8_t base = RAM_IMM;
+
+	DPRINTF("AAM");
+	cpu->ip += 2;
+	if (base == 0)
+	{
+		cpu->cycles += 83;
+		divide_error(cpu);
+		return;
+	}
+	cpu->ax.h = cpu->ax.l / base;
+	cpu->ax.l = cpu->ax.l % base;
+	flags_szp8(cpu, cpu->ax.l);
+	cpu->cycles += 83;
+}
 
+/* 0xD5 AAD */
+static inline void aad(X86Cpu *cpu)
+{
+	DPRINTF("AAD");
+	cpu->ax.l = cpu->ax.h * RAM_IMM + cpu->ax.l;
+	cpu->ax.h = 0;
+	flags_szp8(cpu, cpu->ax.l);
+	cpu->ip += 2;
+	cpu->cycles += 60;
+}
+
+/* 0xCC INT 3, 0xCD INT n, 0xCE INTO */
+static inline void int_op(X86Cpu *cpu)
+{
+	uint8_t op = cpu->ram[PC];
+	uint8_t vector;
+
+	switch (op)
+	{
+		case 0xCC:
+			vector = 3;
+			cpu->ip++;
+			cpu->cycles += INT_CYCLES + 1;
+			break;
+		case 0xCD:
+			vector = RAM_IMM;
+			cpu->ip += 2;
+			cpu->cycles += INT_CYCLES;
+			break;
 		default:
-			fprintf(stderr, "unhandled mov %x",tmp);
-			cpu->running = 0;
+			cpu->ip++;
+			if (!FLAG_TST(FLAGS_OV))
+			{
+				cpu->cycles += 4;
+				return;
+			}
+			vector = 4;
+			cpu->cycles += INT_CYCLES + 2;
+			break;
+	}
+	DPRINTF("INT %.2X", vector);
+	interrupt(cpu, vector);
+}
+
+/* 0xCF */
+static inline void iret(X86Cpu *cpu)
+{
+	DPRINTF("IRET");
+	cpu->ip = pop16(cpu);
+	cpu->cs = pop16(cpu);
+	cpu->flags = pop16(cpu);
+	intr_sync(cpu);
+	cpu->cycles += 44;
+}
+
+/* 0xFB, IF only takes effect after the next instruction */
+static inline void sti(X86Cpu *cpu)
+{
+	DPRINTF("STI");
+	set_flag(cpu, FLAGS_INT);
+	intr_sync(cpu);
+	cpu->pending |= PENDING_SHADOW;
+	cpu->ip++;
+	cpu->cycles += 2;
+}
 
+/* 0x8E MOV Sreg,r/m16 */
+static inline void mov_sreg(X86Cpu *cpu)
+{
+	ModRM m;
 
+	modrm(cpu, &m);
+	DPRINTF("MOV SREG");
+	*sreg(cpu, m.reg) = rm_read16(cpu, &m);
+	//so a MOV SS, MOV SP pair can't be split by an interrupt
+	if ((m.reg & 3) == 2)
+		cpu->pending |= PENDING_SHADOW;
+	cpu->ip += 1 + m.len;
+	cpu->cycles += m.mod == 3 ? 2 : 12 + m.ea;
+}
 
+/* 0x06 0x0E 0x16 0x1E PUSH Sreg, 0x07 0x17 0x1F POP Sreg */
+static inline void push_pop_sreg(X86Cpu *cpu)
+{
+	uint8_t op = cpu->ram[PC];
+	int reg = (op >> 3) & 3;
 
+	if (op & 1)
+	{
+		DPRINTF("POP SREG");
+		*sreg(cpu, reg) = pop16(cpu);
+		if (reg == 2)
+			cpu->pending |= PENDING_SHADOW;
+		cpu->cycles += 12;
+	}
+	else
+	{
+		DPRINTF("PUSH SREG");
+		push16(cpu, *sreg(cpu, reg));
+		cpu->cycles += 14;
+	}
+	cpu->ip++;
+}
+
+/* 0xE4-0xE7 IN/OUT with an immediate port, 0xEC-0xEF with the port in DX */
+static inline void in_out(X86Cpu *cpu)
+{
+	uint8_t op = cpu->ram[PC];
+	uint16_t port;
+
+	if (op & 0x08)
+	{
+		port = cpu->dx.w;
+		cpu->ip++;
+		cpu->cycles += 8;
+	}
+	else
+	{
+		port = RAM_IMM;
+		cpu->ip += 2;
+		cpu->cycles += 10;
+	}
+	//a word transfer is a second bus cycle on the 8088
+	if (op & 1)
+		cpu->cycles += 4;
+
+	switch (op & 3)
+	{
+		case 0:
+			DPRINTF("IN AL,%.4X", port);
+			cpu->ax.l = io_read8(cpu, port);
+			break;
+		case 1:
+			DPRINTF("IN AX,%.4X", port);
+			cpu->ax.w = io_read16(cpu, port);
+			break;
+		case 2:
+			DPRINTF("OUT %.4X,AL", port);
+			io_write8(cpu, port, cpu->ax.l);
+			break;
+		default:
+			DPRINTF("OUT %.4X,AX", port);
+			io_write16(cpu, port, cpu->ax.w);
+			break;
 	}
-	
-	cpu->ip += 2;
 }
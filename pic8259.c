@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intel8086.h"
+#include "pic8259.h"
+#include "io.h"
+
+/* Intel 8259A in the single, 8086 mode configuration of the 5150.
+ *
+ * Whenever IRR, ISR, IMR or the priority changes the INTR output is worked
+ * out once and pushed to the cpu's pending mask, so the cpu never polls the
+ * PIC.  Priorities are resolved by rotating the registers so the highest
+ * priority IRQ lands in bit 0 and taking count trailing zeros. */
+
+#define ICW1_ICW4	0x01
+#define ICW1_SINGLE	0x02
+#define ICW1_LTIM	0x04
+#define ICW4_AEOI	0x02
+
+//rotate so bit 0 is the highest priority IRQ
+static inline uint8_t by_priority(Pic8259 *pic, uint8_t reg)
+{
+	int hp = (pic->lowest + 1) & 7;
+
+	return (reg >> hp | reg << (8 - hp)) & 0xFF;
+}
+
+//highest priority IRQ set in reg, or -1
+static inline int highest(Pic8259 *pic, uint8_t reg)
+{
+	uint8_t r = by_priority(pic, reg);
+
+	if (r == 0)
+		return -1;
+	return (__builtin_ctz(r) + pic->lowest + 1) & 7;
+}
+
+//raise INTR when an unmasked request beats everything in service
+static void pic_update(X86Cpu *cpu)
+{
+	Pic8259 *pic = &cpu->pic;
+	uint8_t req = by_priority(pic, pic->irr & ~pic->imr);
+	uint8_t srv = by_priority(pic, pic->isr);
+	int out = 0;
+
+	if (pic->init == 0 && req)
+		out = srv == 0 || __builtin_ctz(req) < __builtin_ctz(srv);
+	intr_8086(cpu, out);
+}
+
+static void pic_eoi(Pic8259 *pic, int irq, int rotate)
+{
+	if (irq < 0)
+		return;
+	pic->isr &= ~(1 << irq);
+	if (rotate)
+		pic->lowest = irq;
+}
+
+//INTA: hand over the vector, IRQ 7 if the request went away meanwhile
+static uint8_t pic_ack(X86Cpu *cpu)
+{
+	Pic8259 *pic = &cpu->pic;
+	int irq = highest(pic, pic->irr & ~pic->imr);
+
+	if (irq < 0)
+		return pic->base | 7;
+
+	if (!(pic->icw1 & ICW1_LTIM))
+		pic->irr &= ~(1 << irq);
+	if (pic->icw4 & ICW4_AEOI)
+	{
+		if (pic->rotate_aeoi)
+			pic->lowest = irq;
+	}
+	else
+		pic->isr |= 1 << irq;
+
+	pic_update(cpu);
+	return pic->base | irq;
+}
+
+//power on state is what the BIOS sets up: vector 8, edge triggered, all masked
+static const IoHandler pic_ports = { pic_read, pic_write, NULL, NULL };
+
+void pic_init(X86Cpu *cpu)
+{
+	Pic8259 *pic = &cpu->pic;
+
+	memset(pic, 0, sizeof(Pic8259));
+	pic->base = 0x08;
+	pic->icw1 = ICW1_ICW4 | ICW1_SINGLE;
+	pic->icw4 = 0x01;
+	pic->imr = 0xFF;
+	pic->lowest = 7;
+	cpu->intr_ack = pic_ack;
+	io_register(cpu, PIC_PORT, 2, &pic_ports);
+}
+
+void pic_irq(X86Cpu *cpu, int irq, int level)
+{
+	Pic8259 *pic = &cpu->pic;
+	uint8_t bit = 1 << irq;
+
+	if (level)
+	{
+		if (!(pic->lines & bit) || (pic->icw1 & ICW1_LTIM))
+			pic->irr |= bit;
+		pic->lines |= bit;
+	}
+	else
+	{
+		pic->lines &= ~bit;
+		if (pic->icw1 & ICW1_LTIM)
+			pic->irr &= ~bit;
+	}
+	pic_update(cpu);
+}
+
+uint8_t pic_read(X86Cpu *cpu, uint16_t port)
+{
+	Pic8259 *pic = &cpu->pic;
+	int irq;
+
+	if (pic->poll)
+	{
+		//poll command: acknowledge without an INTA cycle
+		pic->poll = 0;
+		irq = highest(pic, pic->irr & ~pic->imr);
+		if (irq < 0)
+			return 0;
+		pic_ack(cpu);
+		return 0x80 | irq;
+	}
+	if (port & 1)
+		return pic->imr;
+	return pic->read_isr ? pic->isr : pic->irr;
+}
+
+void pic_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	Pic8259 *pic = &cpu->pic;
+
+	if (!(port & 1))
+	{
+		if (val & 0x10)
+		{
+			//ICW1 starts initialisation and clears everything
+			pic->icw1 = val;
+			pic->icw4 = 0;
+			pic->imr = 0;
+			pic->isr = 0;
+			pic->irr = 0;
+			pic->lowest = 7;
+			pic->read_isr = 0;
+			pic->rotate_aeoi = 0;
+			pic->init = 2;
+		}
+		else if (val & 0x08)
+		{
+			//OCW3
+			if (val & 0x02)
+				pic->read_isr = val & 0x01;
+			pic->poll = (val & 0x04) != 0;
+		}
+		else
+		{
+			//OCW2: R SL EOI in bits 7-5, level in 2-0
+			switch (val >> 5)
+			{
+				case 1:	pic_eoi(pic, highest(pic, pic->isr), 0); break;
+				case 3:	pic_eoi(pic, val & 7, 0); break;
+				case 5:	pic_eoi(pic, highest(pic, pic->isr), 1); break;
+				case 4:	pic->rotate_aeoi = 1; break;
+				case 0:	pic->rotate_aeoi = 0; break;
+				case 7:	pic_eoi(pic, val & 7, 1); break;
+				case 6:	pic->lowest = val & 7; break;
+			}
+		}
+	}
+	else
+	{
+		switch (pic->init)
+		{
+			case 2:
+				pic->base = val & 0xF8;
+				//ICW3 only exists in cascade mode
+				if (!(pic->icw1 & ICW1_SINGLE))
+					pic->init = 3;
+				else
+					pic->init = pic->icw1 & ICW1_ICW4 ? 4 : 0;
+				break;
+			case 3:
+				pic->init = pic->icw1 & ICW1_ICW4 ? 4 : 0;
+				break;
+			case 4:
+				pic->icw4 = val;
+				pic->init = 0;
+				break;
+			default:
+				//OCW1
+				pic->imr = val;
+				break;
+		}
+	}
+	pic_update(cpu);
+}
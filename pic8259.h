@@ -0,0 +1,41 @@
+#ifndef PIC8259_H
+#define PIC8259_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+struct X86Cpu;
+
+//the 5150 has one 8259A at ports 20h-21h
+#define PIC_PORT 0x20
+
+typedef struct {
+	uint8_t irr, isr, imr;
+	uint8_t lines;		//input levels, for edge detection
+	uint8_t base;		//ICW2 vector base
+	uint8_t icw1, icw4;
+	uint8_t init;		//next ICW expected, 0 when initialised
+	uint8_t read_isr;	//OCW3 selects ISR for reads of port 20h
+	uint8_t poll;
+	uint8_t lowest;		//lowest priority IRQ, rotation moves it
+	uint8_t rotate_aeoi;
+} Pic8259;
+
+void pic_init(struct X86Cpu *cpu);
+void pic_irq(struct X86Cpu *cpu, int irq, int level);
+uint8_t pic_read(struct X86Cpu *cpu, uint16_t port);
+void pic_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intel8086.h"
+#include "pit8253.h"
+#include "pic8259.h"
+#include "sched.h"
+#include "io.h"
+
+/* Intel 8253 timer.  Nothing runs per clock: a channel remembers the cycle
+ * its count was loaded, and the counter and OUT are worked out from
+ * X86Cpu.cycles when the guest looks.  Channel 0 (IRQ 0) schedules one
+ * event for its next rising edge of OUT; channels 1 (DRAM refresh) and 2
+ * (speaker) are only ever read.
+ *
+ * A low gate holds the count in modes 0, 2, 3 and 4, as if time stood still
+ * for the channel, and forces OUT high in 2 and 3.  Modes 1 and 5 count
+ * regardless but only start on a rising edge of the gate.
+ *
+ * BCD counting is accepted but counts in binary, and a new count in modes
+ * 2 and 3 restarts the period at once instead of at the next reload. */
+
+//the gate is low and this mode stops counting for it
+static int held(PitChannel *c)
+{
+	return !c->gate && c->mode != 1 && c->mode != 5;
+}
+
+static uint64_t elapsed(X86Cpu *cpu, PitChannel *c)
+{
+	return ((held(c) ? c->paused : cpu->cycles) - c->start) / PIT_DIVISOR;
+}
+
+static uint16_t pit_counter(X86Cpu *cpu, PitChannel *c)
+{
+	uint64_t t, half;
+
+	if (!c->armed)
+		return c->count;
+	t = elapsed(cpu, c);
+	switch (c->mode)
+	{
+		case 2:
+			return c->count - t % c->count;
+		case 3:
+			//counts down by two through each half of the period
+			t %= c->count;
+			half = (c->count + 1) / 2;
+			if (t >= half)
+				t -= half;
+			return c->count - 2 * t;
+		default:
+			//0, 1, 4, 5 keep wrapping after terminal count
+			return c->count - t;
+	}
+}
+
+int pit_out(X86Cpu *cpu, int ch)
+{
+	PitChannel *c = &cpu->pit.ch[ch];
+	uint64_t t;
+
+	if (!c->armed)
+		return c->mode != 0;
+	if (held(c) && (c->mode == 2 || c->mode == 3))
+		return 1;
+	t = elapsed(cpu, c);
+	switch (c->mode)
+	{
+		case 0:
+		case 1:
+			return t >= c->count;
+		case 2:
+			return t % c->count != c->count - 1;
+		case 3:
+			return t % c->count < (c->count + 1) / 2;
+		default:
+			return t != c->count;
+	}
+}
+
+//cycle of the next low to high change of OUT after now, or UINT64_MAX
+static uint64_t next_rise(X86Cpu *cpu, PitChannel *c)
+{
+	uint64_t t, at;
+
+	if (!c->armed || held(c))
+		return UINT64_MAX;
+	t = elapsed(cpu, c);
+	switch (c->mode)
+	{
+		case 0:
+		case 1:
+			if (t >= c->count)
+				return UINT64_MAX;
+			at = c->count;
+			break;
+		case 2:
+		case 3:
+			at = (t / c->count + 1) * c->count;
+			break;
+		default:
+			if (t > c->count)
+				return UINT64_MAX;
+			at = c->count + 1;
+			break;
+	}
+	return c->start + at * PIT_DIVISOR;
+}
+
+static void pit_schedule(X86Cpu *cpu)
+{
+	uint64_t when = next_rise(cpu, &cpu->pit.ch[0]);
+
+	if (when == UINT64_MAX)
+		sched_cancel(cpu, SCHED_PIT);
+	else
+		sched_at(cpu, SCHED_PIT, when);
+}
+
+//OUT0 just went high: give the edge triggered IRQ 0 its edge
+static void pit_event(X86Cpu *cpu)
+{
+	pic_irq(cpu, 0, 0);
+	pic_irq(cpu, 0, 1);
+	pit_schedule(cpu);
+}
+
+static const IoHandler pit_ports = { pit_read, pit_write, NULL, NULL };
+
+void pit_init(X86Cpu *cpu)
+{
+	int i;
+
+	memset(&cpu->pit, 0, sizeof(Pit8253));
+	for (i = 0; i < 3; i++)
+	{
+		cpu->pit.ch[i].count = 0x10000;
+		cpu->pit.ch[i].rw = 3;
+		cpu->pit.ch[i].gate = 1;
+	}
+	sched_register(cpu, SCHED_PIT, pit_event);
+	io_register(cpu, PIT_PORT, 4, &pit_ports);
+}
+
+static void pit_load(X86Cpu *cpu, int ch, uint16_t val)
+{
+	PitChannel *c = &cpu->pit.ch[ch];
+
+	c->count = val ? val : 0x10000;
+	c->start = c->paused = cpu->cycles;
+	//modes 1 and 5 wait for the gate to trigger them
+	c->waiting = c->mode == 1 || c->mode == 5;
+	c->armed = !c->waiting;
+	if (ch == 0)
+	{
+		pic_irq(cpu, 0, pit_out(cpu, 0));
+		pit_schedule(cpu);
+	}
+}
+
+uint8_t pit_read(X86Cpu *cpu, uint16_t port)
+{
+	PitChannel *c;
+	uint16_t val;
+	uint8_t byte;
+
+	port &= 3;
+	if (port == 3)
+		return 0xFF;
+	c = &cpu->pit.ch[port];
+
+	if (c->latched)
+	{
+		val = c->latch;
+		c->latched--;
+	}
+	else
+		val = pit_counter(cpu, c);
+
+	switch (c->rw)
+	{
+		case 1:
+			return val & 0xFF;
+		case 2:
+			return val >> 8;
+		default:
+			byte = c->read_msb ? val >> 8 : val & 0xFF;
+			c->read_msb ^= 1;
+			return byte;
+	}
+}
+
+void pit_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	PitChannel *c;
+	int ch;
+
+	port &= 3;
+	if (port == 3)
+	{
+		ch = val >> 6;
+		if (ch == 3)
+			return;
+		c = &cpu->pit.ch[ch];
+		if ((val & 0x30) == 0)
+		{
+			//counter latch command
+			c->latch = pit_counter(cpu, c);
+			c->latched = c->rw == 3 ? 2 : 1;
+			return;
+		}
+		c->rw = (val >> 4) & 3;
+		c->mode = (val >> 1) & 7;
+		if (c->mode > 5)
+			c->mode -= 4;
+		c->bcd = val & 1;
+		c->armed = 0;
+		c->waiting = 0;
+		c->latched = 0;
+		c->read_msb = 0;
+		c->write_msb = 0;
+		if (ch == 0)
+		{
+			pic_irq(cpu, 0, c->mode != 0);
+			pit_schedule(cpu);
+		}
+		return;
+	}
+
+	c = &cpu->pit.ch[port];
+	switch (c->rw)
+	{
+		case 1:
+			pit_load(cpu, port, val);
+			break;
+		case 2:
+			pit_load(cpu, port, val << 8);
+			break;
+		default:
+			if (!c->write_msb)
+			{
+				c->write_lsb = val;
+				c->write_msb = 1;
+				//mode 0 stops counting until the count is complete
+				if (c->mode == 0)
+					c->armed = 0;
+			}
+			else
+			{
+				c->write_msb = 0;
+				pit_load(cpu, port, c->write_lsb | val << 8);
+			}
+			break;
+	}
+}
+
+/* Channel 2's gate is PPI port 61h bit 0.  Going low holds the count, going
+ * high again resumes modes 0 and 4 where they were, restarts 2 and 3 and
+ * triggers 1 and 5. */
+void pit_gate(X86Cpu *cpu, int ch, int level)
+{
+	PitChannel *c = &cpu->pit.ch[ch];
+
+	if (!level && c->gate)
+		c->paused = cpu->cycles;
+	else if (level && !c->gate)
+	{
+		if (c->mode == 0 || c->mode == 4)
+			c->start += cpu->cycles - c->paused;
+		else if (c->armed || c->waiting)
+		{
+			c->start = cpu->cycles;
+			c->armed = 1;
+			c->waiting = 0;
+		}
+	}
+	c->gate = level;
+	if (ch == 0)
+		pit_schedule(cpu);
+}
@@ -0,0 +1,52 @@
+#ifndef PIT8253_H
+#define PIT8253_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+struct X86Cpu;
+
+//ports 40h-43h, clocked at 1.19MHz, a quarter of the cpu clock
+#define PIT_PORT 0x40
+#define PIT_DIVISOR 4
+
+typedef struct {
+	uint64_t start;		//cpu cycle the current count was loaded
+	uint64_t paused;	//cycle the gate went low and held the count
+	uint32_t count;		//1-65536
+	uint16_t latch;
+	uint8_t mode;
+	uint8_t rw;		//1 LSB, 2 MSB, 3 LSB then MSB
+	uint8_t bcd;
+	uint8_t armed;		//count loaded and counting
+	uint8_t waiting;	//modes 1 and 5: count loaded, no trigger yet
+	uint8_t gate;
+	uint8_t latched;	//bytes of latch left to read
+	uint8_t read_msb;	//next read/write in mode 3 is the MSB
+	uint8_t write_msb;
+	uint8_t write_lsb;	//LSB half of a count being written
+} PitChannel;
+
+typedef struct {
+	PitChannel ch[3];
+} Pit8253;
+
+void pit_init(struct X86Cpu *cpu);
+uint8_t pit_read(struct X86Cpu *cpu, uint16_t port);
+void pit_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+int pit_out(struct X86Cpu *cpu, int ch);
+void pit_gate(struct X86Cpu *cpu, int ch, int level);
+
+#endif
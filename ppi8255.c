@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intel8086.h"
+#include "ppi8255.h"
+#include "pic8259.h"
+#include "pit8253.h"
+#include "io.h"
+
+/* Intel 8255 as wired on the 5150.  The mode set on port 63h is taken for
+ * granted (A and C in, B out) and only stored.  The keyboard's serial link
+ * ends in a shift register read on port A; kbd.c fills it through
+ * ppi_kbd_byte() whenever ppi_kbd_ready() says the BIOS has acknowledged
+ * the last byte. */
+
+uint8_t ppi_read(X86Cpu *cpu, uint16_t port)
+{
+	Ppi8255 *ppi = &cpu->ppi;
+	uint8_t val;
+
+	switch (port & 3)
+	{
+		case 0:
+			if (ppi->port_b & PPI_B_KBD_CLEAR)
+				return ppi->sw1;
+			return ppi->scancode;
+		case 1:
+			return ppi->port_b;
+		case 2:
+			if (ppi->port_b & PPI_B_SW2_HIGH)
+				val = (ppi->sw2 >> 4) & 0x01;
+			else
+				val = ppi->sw2 & 0x0F;
+			if (pit_out(cpu, 2))
+				val |= 0x20;
+			return val;
+		default:
+			return ppi->control;
+	}
+}
+
+void ppi_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	Ppi8255 *ppi = &cpu->ppi;
+	uint8_t old = ppi->port_b;
+
+	switch (port & 3)
+	{
+		case 1:
+			ppi->port_b = val;
+			if ((old ^ val) & PPI_B_GATE2)
+				pit_gate(cpu, 2, val & PPI_B_GATE2);
+			if (!(old & PPI_B_KBD_CLK) && (val & PPI_B_KBD_CLK))
+				ppi->kbd_reset = 1;
+			if (val & PPI_B_KBD_CLEAR)
+			{
+				ppi->kbd_full = 0;
+				ppi->scancode = 0;
+				pic_irq(cpu, 1, 0);
+			}
+			break;
+		case 3:
+			ppi->control = val;
+			break;
+	}
+}
+
+//clock running, latch empty and not being held clear
+int ppi_kbd_ready(X86Cpu *cpu)
+{
+	Ppi8255 *ppi = &cpu->ppi;
+
+	return !ppi->kbd_full && (ppi->port_b & PPI_B_KBD_CLK)
+		&& !(ppi->port_b & PPI_B_KBD_CLEAR);
+}
+
+void ppi_kbd_byte(X86Cpu *cpu, uint8_t code)
+{
+	cpu->ppi.scancode = code;
+	cpu->ppi.kbd_full = 1;
+	pic_irq(cpu, 1, 1);
+}
+
+static const IoHandler ppi_ports = { ppi_read, ppi_write, NULL, NULL };
+
+void ppi_init(X86Cpu *cpu)
+{
+	memset(&cpu->ppi, 0, sizeof(Ppi8255));
+	cpu->ppi.sw1 = PPI_SW1_DEFAULT;
+	cpu->ppi.sw2 = PPI_SW2_DEFAULT;
+	cpu->ppi.control = 0x99;
+	io_register(cpu, PPI_PORT, 4, &ppi_ports);
+}
@@ -0,0 +1,50 @@
+#ifndef PPI8255_H
+#define PPI8255_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+struct X86Cpu;
+
+//ports 60h-63h: A keyboard/SW1, B control outputs, C SW2 and status inputs
+#define PPI_PORT 0x60
+
+//port B bits
+#define PPI_B_GATE2	0x01	//PIT channel 2 gate
+#define PPI_B_SPEAKER	0x02
+#define PPI_B_SW2_HIGH	0x04	//port C shows SW2 bit 4 instead of 0-3
+#define PPI_B_KBD_CLK	0x40	//low holds the keyboard clock, high again resets it
+#define PPI_B_KBD_CLEAR	0x80	//clear the keyboard latch, port A shows SW1
+
+//CGA 80x25, one floppy drive, 64K on the planar; 640K total on SW2
+#define PPI_SW1_DEFAULT 0x2D
+#define PPI_SW2_DEFAULT 0x12
+
+typedef struct {
+	uint8_t port_b;
+	uint8_t control;
+	uint8_t sw1, sw2;
+	uint8_t scancode;	//byte in the keyboard shift register
+	uint8_t kbd_full;	//scancode is waiting, IRQ 1 is up
+	uint8_t kbd_reset;	//keyboard was reset and owes an AAh
+} Ppi8255;
+
+void ppi_init(struct X86Cpu *cpu);
+uint8_t ppi_read(struct X86Cpu *cpu, uint16_t port);
+void ppi_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+int ppi_kbd_ready(struct X86Cpu *cpu);
+void ppi_kbd_byte(struct X86Cpu *cpu, uint8_t code);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sched.h"
+
+static void sched_update(X86Cpu *cpu)
+{
+	uint64_t next = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < SCHED_MAX; i++)
+		if (cpu->events[i].when < next)
+			next = cpu->events[i].when;
+	cpu->next_event = next;
+}
+
+void sched_init(X86Cpu *cpu)
+{
+	int i;
+
+	for (i = 0; i < SCHED_MAX; i++)
+	{
+		cpu->events[i].when = UINT64_MAX;
+		cpu->events[i].fn = NULL;
+	}
+	cpu->next_event = UINT64_MAX;
+}
+
+void sched_register(X86Cpu *cpu, int id, void (*fn)(X86Cpu *cpu))
+{
+	cpu->events[id].fn = fn;
+}
+
+void sched_at(X86Cpu *cpu, int id, uint64_t when)
+{
+	cpu->events[id].when = when;
+	if (when < cpu->next_event)
+		cpu->next_event = when;
+	else
+		sched_update(cpu);
+}
+
+void sched_cancel(X86Cpu *cpu, int id)
+{
+	cpu->events[id].when = UINT64_MAX;
+	sched_update(cpu);
+}
+
+//fire everything that is due, handlers may schedule themselves again
+void sched_run(X86Cpu *cpu)
+{
+	int i;
+
+	while (cpu->next_event <= cpu->cycles)
+	{
+		for (i = 0; i < SCHED_MAX; i++)
+		{
+			if (cpu->events[i].when > cpu->cycles)
+				continue;
+			cpu->events[i].when = UINT64_MAX;
+			if (cpu->events[i].fn)
+				cpu->events[i].fn(cpu);
+		}
+		sched_update(cpu);
+	}
+}
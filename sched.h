@@ -0,0 +1,37 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include "intel8086.h"
+
+/* Devices never tick per cycle.  Each owns one event slot and asks to be
+ * called back when X86Cpu.cycles reaches a given value; the cpu checks
+ * cycles against next_event once per instruction, and long REP string ops
+ * stop at it too.  Slot numbers are handed out here. */
+#define SCHED_PIT	0
+#define SCHED_DMA_REFRESH	1
+#define SCHED_KBD	2
+#define SCHED_VIDEO	3
+#define SCHED_FDC	4
+#define SCHED_HDC	5
+
+void sched_init(X86Cpu *cpu);
+void sched_register(X86Cpu *cpu, int id, void (*fn)(X86Cpu *cpu));
+void sched_at(X86Cpu *cpu, int id, uint64_t when);
+void sched_cancel(X86Cpu *cpu, int id);
+void sched_run(X86Cpu *cpu);
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "screenshot.h"
+
+//bitwise, so there's no table to share between threads
+static uint32_t crc_update(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	size_t i;
+	int k;
+
+	for (i = 0; i < len; i++)
+	{
+		crc ^= buf[i];
+		for (k = 0; k < 8; k++)
+			crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+	}
+	return crc;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int png_chunk(FILE *fp, const char *type, const uint8_t *data,
+	uint32_t len)
+{
+	uint8_t hdr[8], tail[4];
+	uint32_t crc;
+
+	put32(hdr, len);
+	memcpy(hdr + 4, type, 4);
+	crc = crc_update(0xFFFFFFFF, hdr + 4, 4);
+	crc = crc_update(crc, data, len);
+	put32(tail, crc ^ 0xFFFFFFFF);
+	return fwrite(hdr, 8, 1, fp) == 1
+		&& (len == 0 || fwrite(data, len, 1, fp) == 1)
+		&& fwrite(tail, 4, 1, fp) == 1;
+}
+
+//rows of filter byte 0 and RGB, then zlib framing around stored deflate blocks
+static int save_png(FILE *fp, const uint8_t *rgb, int width, int height)
+{
+	static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	size_t row = (size_t)width * 3 + 1, raw = row * height;
+	size_t blocks = (raw + 0xFFFE) / 0xFFFF, at, i, n, pos;
+	uint8_t ihdr[13], *z;
+	uint32_t a = 1, b = 0;
+	int ok;
+
+	z = malloc(2 + raw + blocks * 5 + 4);
+	if (z == NULL)
+		return 0;
+	z[0] = 0x78;
+	z[1] = 0x01;
+	pos = 2;
+	for (i = 0; i < raw; i += n)
+	{
+		n = raw - i < 0xFFFF ? raw - i : 0xFFFF;
+		z[pos++] = i + n == raw;
+		z[pos++] = n & 0xFF;
+		z[pos++] = n >> 8;
+		z[pos++] = ~n & 0xFF;
+		z[pos++] = ~n >> 8 & 0xFF;
+		for (at = i; at < i + n; at++)
+		{
+			z[pos] = at % row == 0 ? 0
+				: rgb[at / row * (row - 1) + at % row - 1];
+			a = (a + z[pos]) % 65521;
+			b = (b + a) % 65521;
+			pos++;
+		}
+	}
+	put32(z + pos, b << 16 | a);
+	pos += 4;
+
+	put32(ihdr, width);
+	put32(ihdr + 4, height);
+	ihdr[8] = 8;		//bit depth
+	ihdr[9] = 2;		//truecolour
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	ok = fwrite(sig, 8, 1, fp) == 1
+		&& png_chunk(fp, "IHDR", ihdr, 13)
+		&& png_chunk(fp, "IDAT", z, pos)
+		&& png_chunk(fp, "IEND", NULL, 0);
+	free(z);
+	return ok;
+}
+
+int screenshot_save(const char *filename, const uint32_t *pixels, int width,
+	int height)
+{
+	size_t len = strlen(filename), i, n = (size_t)width * height;
+	uint8_t *rgb;
+	FILE *fp;
+	int ok;
+
+	if (width <= 0 || height <= 0)
+		return -1;
+	rgb = malloc(n * 3);
+	if (rgb == NULL)
+		return -1;
+	for (i = 0; i < n; i++)
+	{
+		rgb[i * 3] = pixels[i] >> 16;
+		rgb[i * 3 + 1] = pixels[i] >> 8;
+		rgb[i * 3 + 2] = pixels[i];
+	}
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+	{
+		free(rgb);
+		return -1;
+	}
+	if (len > 4 && strcmp(filename + len - 4, ".png") == 0)
+		ok = save_png(fp, rgb, width, height);
+	else
+		ok = fprintf(fp, "P6\n%d %d\n255\n", width, height) > 0
+			&& fwrite(rgb, n * 3, 1, fp) == 1;
+	free(rgb);
+	if (fclose(fp) != 0)
+		ok = 0;
+	return ok ? 0 : -1;
+}
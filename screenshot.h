@@ -0,0 +1,24 @@
+#ifndef SCREENSHOT_H
+#define SCREENSHOT_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+/* Write 0xRRGGBB pixels as a binary PPM, or as a PNG if the name ends in
+ * .png.  The PNG is stored uncompressed so no zlib is needed. */
+int screenshot_save(const char *filename, const uint32_t *pixels, int width,
+	int height);
+
+#endif
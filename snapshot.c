@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+#include "mem.h"
+#include "dos.h"
+
+void snapshot_take(Snapshot *snap, X86Cpu *cpu)
+{
+	snap->state = *cpu;
+	snap->state.ram = NULL;
+	memcpy(snap->ram, cpu->ram, RAM_SIZE);
+}
+
+//host side settings survive a restore, only guest state is rewound
+static void restore_state(X86Cpu *cpu, X86Cpu *state)
+{
+	uint8_t *ram = cpu->ram;
+	struct MemMap *mem = cpu->mem;
+	struct IoMap *io = cpu->io;
+	struct Kbd *kbd = cpu->kbd;
+	struct Display *display = cpu->display;
+	struct Floppy *floppy = cpu->floppy;
+	struct HardDisk *hdisk = cpu->hdisk;
+	struct Dos *dos = cpu->dos;
+	int trace = cpu->trace;
+	uint8_t (*intr_ack)(X86Cpu *cpu) = cpu->intr_ack;
+	void (*fn[SCHED_MAX])(X86Cpu *cpu);
+	int i;
+
+	//event handlers are code addresses, only the times are guest state
+	for (i = 0; i < SCHED_MAX; i++)
+		fn[i] = cpu->events[i].fn;
+
+	*cpu = *state;
+	cpu->ram = ram;
+	cpu->mem = mem;
+	cpu->io = io;
+	cpu->kbd = kbd;
+	cpu->display = display;
+	cpu->floppy = floppy;
+	cpu->hdisk = hdisk;
+	cpu->dos = dos;
+	cpu->trace = trace;
+	cpu->intr_ack = intr_ack;
+	for (i = 0; i < SCHED_MAX; i++)
+		cpu->events[i].fn = fn[i];
+	//RAM is about to be replaced wholesale, watchers see all of it change
+	mem_dirty(cpu, 0, RAM_SIZE);
+}
+
+void snapshot_restore(Snapshot *snap, X86Cpu *cpu)
+{
+	restore_state(cpu, &snap->state);
+	memcpy(cpu->ram, snap->ram, RAM_SIZE);
+}
+
+/* On disk a snapshot is the header, the raw X86Cpu and then all of RAM.  The
+ * struct is written as is, so files are only good for the build that wrote
+ * them; the size in the header catches most mismatches. */
+int snapshot_save(X86Cpu *cpu, char *filename)
+{
+	SnapshotHeader hdr;
+	X86Cpu state = *cpu;
+	FILE *fp;
+	int ok;
+
+	if (dos_files_open(cpu))
+	{
+		fprintf(stderr, "no snapshots while a DOS program has files open\n");
+		return -1;
+	}
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return -1;
+
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.state_size = sizeof(X86Cpu);
+	hdr.ram_size = RAM_SIZE;
+	state.ram = NULL;
+
+	ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+		&& fwrite(&state, sizeof(state), 1, fp) == 1
+		&& fwrite(cpu->ram, RAM_SIZE, 1, fp) == 1;
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	return ok ? 0 : -1;
+}
+
+int snapshot_is_file(char *filename)
+{
+	SnapshotHeader hdr;
+	FILE *fp;
+	int ok;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return 0;
+	ok = fread(&hdr, sizeof(hdr), 1, fp) == 1
+		&& memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) == 0;
+	fclose(fp);
+
+	return ok;
+}
+
+int snapshot_load(X86Cpu *cpu, char *filename)
+{
+	SnapshotHeader hdr;
+	X86Cpu state;
+	FILE *fp;
+	int ok;
+
+	if (dos_files_open(cpu))
+	{
+		fprintf(stderr, "no snapshots while a DOS program has files open\n");
+		return -1;
+	}
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return -1;
+
+	ok = fread(&hdr, sizeof(hdr), 1, fp) == 1
+		&& memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) == 0
+		&& hdr.version == SNAPSHOT_VERSION
+		&& hdr.state_size == sizeof(X86Cpu)
+		&& hdr.ram_size == RAM_SIZE
+		&& fread(&state, sizeof(state), 1, fp) == 1
+		&& fread(cpu->ram, RAM_SIZE, 1, fp) == 1;
+	fclose(fp);
+	if (!ok)
+		return -1;
+
+	restore_state(cpu, &state);
+	return 0;
+}
+
+int history_init(History *hist, int nslots, uint64_t interval)
+{
+	int i;
+
+	memset(hist, 0, sizeof(History));
+	hist->slots = calloc(nslots, sizeof(Snapshot));
+	if (hist->slots == NULL)
+		return -1;
+
+	for (i = 0; i < nslots; i++)
+	{
+		hist->slots[i].ram = malloc(RAM_SIZE);
+		if (hist->slots[i].ram == NULL)
+		{
+			hist->nslots = i;
+			history_free(hist);
+			return -1;
+		}
+	}
+	hist->nslots = nslots;
+	hist->interval = interval;
+	return 0;
+}
+
+void history_free(History *hist)
+{
+	int i;
+
+	for (i = 0; i < hist->nslots; i++)
+		free(hist->slots[i].ram);
+	free(hist->slots);
+	memset(hist, 0, sizeof(History));
+}
+
+void history_checkpoint(History *hist, X86Cpu *cpu)
+{
+	snapshot_take(&hist->slots[hist->head], cpu);
+	hist->head = (hist->head + 1) % hist->nslots;
+	if (hist->count < hist->nslots)
+		hist->count++;
+}
+
+//call once per instruction boundary, checkpoints every interval instructions
+void history_step(History *hist, X86Cpu *cpu)
+{
+	int newest;
+
+	if (hist->nslots == 0 || cpu->insns % hist->interval != 0)
+		return;
+	//already have this one after a step back
+	newest = (hist->head - 1 + hist->nslots) % hist->nslots;
+	if (hist->count && hist->slots[newest].state.insns == cpu->insns)
+		return;
+	history_checkpoint(hist, cpu);
+}
+
+/* Rewind n instructions: restore the newest checkpoint at or before the
+ * target and silently re-execute up to it.  Checkpoints newer than the one
+ * used are dropped, the forward run will lay them down again.  Returns -1 if
+ * the target is older than everything still in the ring. */
+int history_step_back(History *hist, X86Cpu *cpu, uint64_t n)
+{
+	Snapshot *snap = NULL;
+	uint64_t target;
+	int i, slot, trace;
+
+	if (n > cpu->insns)
+		return -1;
+	target = cpu->insns - n;
+
+	//walk from newest to oldest
+	for (i = 0; i < hist->count; i++)
+	{
+		slot = (hist->head - 1 - i + hist->nslots) % hist->nslots;
+		if (hist->slots[slot].state.insns <= target)
+		{
+			snap = &hist->slots[slot];
+			break;
+		}
+	}
+	if (snap == NULL)
+		return -1;
+
+	snapshot_restore(snap, cpu);
+	hist->count -= i;
+	hist->head = (slot + 1) % hist->nslots;
+
+	trace = cpu->trace;
+	cpu->trace = 0;
+	cpu->running = 1;
+	while (cpu->insns < target && cpu->running)
+		do_op(cpu);
+	cpu->trace = trace;
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include "intel8086.h"
+
+/* A checkpoint is the whole X86Cpu plus a private copy of its RAM.  Execution
+ * is deterministic, so any instruction between two checkpoints can be reached
+ * again by restoring the older one and running forward, as long as the guest
+ * touched nothing outside them: disk overlays and a DOS program's console
+ * and files are host state that the run forward would write to again, and
+ * the keyboard queue and script are not rewound, so there is no history
+ * with a disk attached, keys scripted or for a DOS program, and no snapshot
+ * while the program has files open. */
+typedef struct {
+	X86Cpu state;
+	uint8_t *ram;
+} Snapshot;
+
+#define SNAPSHOT_MAGIC "ACRNSNAP"
+//bump whenever X86Cpu changes layout
+#define SNAPSHOT_VERSION 17
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t state_size;
+	uint32_t ram_size;
+} SnapshotHeader;
+
+typedef struct {
+	Snapshot *slots;
+	int nslots;
+	int count;		//valid slots
+	int head;		//next slot to overwrite
+	uint64_t interval;	//instructions between checkpoints
+} History;
+
+int history_init(History *hist, int nslots, uint64_t interval);
+void history_free(History *hist);
+void history_checkpoint(History *hist, X86Cpu *cpu);
+void history_step(History *hist, X86Cpu *cpu);
+int history_step_back(History *hist, X86Cpu *cpu, uint64_t n);
+
+void snapshot_take(Snapshot *snap, X86Cpu *cpu);
+void snapshot_restore(Snapshot *snap, X86Cpu *cpu);
+int snapshot_save(X86Cpu *cpu, char *filename);
+int snapshot_load(X86Cpu *cpu, char *filename);
+int snapshot_is_file(char *filename);
+
+#endif
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "opcode.h"
+#include "mem.h"
+#include "sched.h"
+#include "strscan.h"
+
+/* MOVS CMPS STOS LODS SCAS, 0xA4 - 0xAF.
+ *
+ * Without a prefix these run one element through the normal memory path.
+ * With REP the iterations that stay inside plain RAM (ROM too for reads)
+ * without SI/DI wrapping at 64K are done in one go on cpu->ram with
+ * memmove/memset or the str_scan() search kernels; whatever is left over (MMIO, a 64K or
+ * 1MB wrap, overlapping MOVS) falls back to single elements.  Either way the
+ * registers, flags and cycle count come out as if every iteration had run
+ * on its own.
+ *
+ * A long REP is also cut into chunks that end at the next scheduled device
+ * event, so timers fire at the right cycle.  If that leaves an interrupt
+ * ready the instruction stops there like the real part: CX/SI/DI hold the
+ * remaining count and IP points back at the last prefix byte, so only that
+ * prefix is seen when the instruction restarts after IRET (the 8086 loses
+ * any earlier ones, e.g. REP before a segment override). */
+
+enum { STR_MOVS, STR_CMPS, STR_STOS, STR_LODS, STR_SCAS };
+
+//8088 timings, [kind][word]: single instruction and per REP iteration
+static const uint8_t single_cycles[5][2] = {
+	{ 18, 26 }, { 22, 30 }, { 11, 15 }, { 12, 16 }, { 15, 19 },
+};
+static const uint8_t rep_cycles[5][2] = {
+	{ 17, 25 }, { 22, 30 }, { 10, 14 }, { 13, 17 }, { 15, 19 },
+};
+#define REP_SETUP_CYCLES 9
+
+static int str_kind(uint8_t op)
+{
+	switch (op & 0xFE)
+	{
+		case 0xA4: return STR_MOVS;
+		case 0xA6: return STR_CMPS;
+		case 0xAA: return STR_STOS;
+		case 0xAC: return STR_LODS;
+		default: return STR_SCAS;
+	}
+}
+
+static inline uint16_t str_read(X86Cpu *cpu, uint16_t seg, uint16_t off,
+	int word)
+{
+	if (word)
+		return mem_read16(cpu, seg, off);
+	return mem_read8(cpu, (seg << 4) + off);
+}
+
+static inline void str_write(X86Cpu *cpu, uint16_t seg, uint16_t off,
+	uint16_t val, int word)
+{
+	if (word)
+		mem_write16(cpu, seg, off, val);
+	else
+		mem_write8(cpu, (seg << 4) + off, val);
+}
+
+//one iteration through the normal memory path, returns 1 if it compared equal
+static int str_step(X86Cpu *cpu, int kind, int word)
+{
+	uint16_t src_seg = data_seg(cpu, cpu->ds);
+	int delta = (word ? 2 : 1) * (FLAG_TST(FLAGS_DF) ? -1 : 1);
+	uint16_t a, b;
+	int eq = 0;
+
+	switch (kind)
+	{
+		case STR_MOVS:
+			a = str_read(cpu, src_seg, cpu->si, word);
+			str_write(cpu, cpu->es, cpu->di, a, word);
+			cpu->si += delta;
+			cpu->di += delta;
+			break;
+		case STR_CMPS:
+			a = str_read(cpu, src_seg, cpu->si, word);
+			b = str_read(cpu, cpu->es, cpu->di, word);
+			flags_sub(cpu, a, b, word);
+			eq = a == b;
+			cpu->si += delta;
+			cpu->di += delta;
+			break;
+		case STR_STOS:
+			str_write(cpu, cpu->es, cpu->di, word ? cpu->ax.w : cpu->ax.l,
+				word);
+			cpu->di += delta;
+			break;
+		case STR_LODS:
+			a = str_read(cpu, src_seg, cpu->si, word);
+			if (word)
+				cpu->ax.w = a;
+			else
+				cpu->ax.l = a;
+			cpu->si += delta;
+			break;
+		case STR_SCAS:
+			a = word ? cpu->ax.w : cpu->ax.l;
+			b = str_read(cpu, cpu->es, cpu->di, word);
+			flags_sub(cpu, a, b, word);
+			eq = a == b;
+			cpu->di += delta;
+			break;
+	}
+	return eq;
+}
+
+//elements that fit before off runs past either end of the segment
+static uint32_t seg_room(uint16_t off, int size, int down)
+{
+	if (size == 2 && off == 0xFFFF)
+		return 0;
+	if (down)
+		return off / size + 1;
+	return (0x10000 - off) / size;
+}
+
+//linear start of n elements walked from off in the direction of DF
+static uint32_t span_start(uint16_t seg, uint16_t off, uint32_t n, int size,
+	int down)
+{
+	return (seg << 4) + (down ? off - (n - 1) * size : off);
+}
+
+//value of element i (walk order) of a span already known to be in cpu->ram
+static uint16_t span_elem(X86Cpu *cpu, uint32_t start, uint32_t n,
+	uint32_t i, int size, int down)
+{
+	uint32_t at = start + (down ? n - 1 - i : i) * size;
+
+	if (size == 1)
+		return cpu->ram[at];
+	return cpu->ram[at] | cpu->ram[at + 1] << 8;
+}
+
+/* Run as many of the remaining iterations as possible straight on cpu->ram.
+ * At most max are run.  Returns how many were, 0 if the next one has to go
+ * the slow way.
+ * *stop is set when a CMPS/SCAS ended the repeat early. */
+static uint32_t str_bulk(X86Cpu *cpu, int kind, int word, uint32_t max,
+	int *stop)
+{
+	int size = word ? 2 : 1;
+	int down = FLAG_TST(FLAGS_DF);
+	int stop_on_eq = cpu->rep == 0xF2;
+	uint16_t src_seg = data_seg(cpu, cpu->ds);
+	uint32_t n = cpu->cx.w < max ? cpu->cx.w : max;
+	uint32_t src = 0, dst = 0, len, i, k;
+	uint16_t a, b;
+	int uses_si = kind != STR_STOS && kind != STR_SCAS;
+	int uses_di = kind != STR_LODS;
+
+	if (uses_si && seg_room(cpu->si, size, down) < n)
+		n = seg_room(cpu->si, size, down);
+	if (uses_di && seg_room(cpu->di, size, down) < n)
+		n = seg_room(cpu->di, size, down);
+	if (n == 0)
+		return 0;
+
+	len = n * size;
+	if (uses_si)
+	{
+		src = span_start(src_seg, cpu->si, n, size, down);
+		if (!mem_range_is(cpu, src, len, 0))
+			return 0;
+	}
+	if (uses_di)
+	{
+		dst = span_start(cpu->es, cpu->di, n, size, down);
+		if (!mem_range_is(cpu, dst, len, kind == STR_MOVS || kind == STR_STOS))
+			return 0;
+	}
+
+	k = n;
+	switch (kind)
+	{
+		case STR_MOVS:
+			//memmove only matches element order when the copy runs away
+			//from the overlap
+			if (src < dst + len && dst < src + len
+				&& (down ? dst < src : dst > src))
+				return 0;
+			memmove(&cpu->ram[dst], &cpu->ram[src], len);
+			mem_dirty(cpu, dst, len);
+			break;
+		case STR_STOS:
+			if (!word || cpu->ax.l == cpu->ax.h)
+				memset(&cpu->ram[dst], cpu->ax.l, len);
+			else
+				for (i = 0; i < len; i += 2)
+				{
+					cpu->ram[dst + i] = cpu->ax.l;
+					cpu->ram[dst + i + 1] = cpu->ax.h;
+				}
+			mem_dirty(cpu, dst, len);
+			break;
+		case STR_LODS:
+			a = span_elem(cpu, src, n, n - 1, size, down);
+			if (word)
+				cpu->ax.w = a;
+			else
+				cpu->ax.l = a;
+			break;
+		case STR_SCAS:
+			a = word ? cpu->ax.w : cpu->ax.l;
+			k = str_scan(&cpu->ram[dst], NULL, a, n, size, down, stop_on_eq);
+			if (k < n)
+			{
+				k++;
+				*stop = 1;
+			}
+			b = span_elem(cpu, dst, n, k - 1, size, down);
+			flags_sub(cpu, a, b, word);
+			break;
+		case STR_CMPS:
+			k = str_scan(&cpu->ram[src], &cpu->ram[dst], 0, n, size, down,
+				stop_on_eq);
+			if (k < n)
+			{
+				k++;
+				*stop = 1;
+			}
+			a = span_elem(cpu, src, n, k - 1, size, down);
+			b = span_elem(cpu, dst, n, k - 1, size, down);
+			flags_sub(cpu, a, b, word);
+			break;
+	}
+
+	if (uses_si)
+		cpu->si += (down ? -1 : 1) * (int)(k * size);
+	if (uses_di)
+		cpu->di += (down ? -1 : 1) * (int)(k * size);
+	cpu->cx.w -= k;
+	return k;
+}
+
+void string_op(X86Cpu *cpu, uint8_t op)
+{
+	int kind = str_kind(op);
+	int word = op & 1;
+	int compare = kind == STR_CMPS || kind == STR_SCAS;
+	uint32_t per = rep_cycles[kind][word];
+	uint32_t n, max;
+	uint64_t left;
+	int stop = 0;
+	int eq;
+
+	DPRINTF("%.2x %s%s", op, cpu->rep ? "REP " : "",
+		(char *[]){ "MOVS", "CMPS", "STOS", "LODS", "SCAS" }[kind]);
+
+	if (!cpu->rep)
+	{
+		str_step(cpu, kind, word);
+		cpu->cycles += single_cycles[kind][word];
+		cpu->ip++;
+		return;
+	}
+
+	cpu->cycles += REP_SETUP_CYCLES;
+	while (cpu->cx.w && !stop)
+	{
+		//iterations until the one that reaches the next event
+		max = 0x10000;
+		if (cpu->next_event != UINT64_MAX)
+		{
+			left = cpu->next_event > cpu->cycles
+				? cpu->next_event - cpu->cycles : 0;
+			if (left < (uint64_t)max * per)
+				max = left ? (left + per - 1) / per : 1;
+		}
+
+		n = str_bulk(cpu, kind, word, max, &stop);
+		if (n == 0)
+		{
+			eq = str_step(cpu, kind, word);
+			cpu->cx.w--;
+			n = 1;
+			if (compare && eq == (cpu->rep == 0xF2))
+				stop = 1;
+		}
+		cpu->cycles += n * per;
+
+		if (!cpu->cx.w || stop)
+			break;
+		if (cpu->cycles >= cpu->next_event)
+			sched_run(cpu);
+		if (intr_ready(cpu))
+		{
+			cpu->ip--;
+			return;
+		}
+	}
+	cpu->ip++;
+}
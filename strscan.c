@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strscan.h"
+
+/* AVX2 and SSE2 versions compare 32 or 16 bytes at a time and pick the first
+ * hit out of the movemask with a bit scan; the cpu is checked on every call
+ * (it's one load), so there is no global dispatch table to set up.  Other
+ * hosts, and the tails, use the scalar loop. */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+static inline int elem_eq(const uint8_t *a, const uint8_t *b, uint16_t val,
+	uint32_t at, int size)
+{
+	if (size == 1)
+		return a[at] == (b ? b[at] : (uint8_t)val);
+	if (b)
+		return a[at] == b[at] && a[at + 1] == b[at + 1];
+	return (a[at] | a[at + 1] << 8) == val;
+}
+
+//walk index of the first hit among elements [first, last) in memory order
+static uint32_t scan_scalar(const uint8_t *a, const uint8_t *b, uint16_t val,
+	uint32_t n, uint32_t first, uint32_t last, int size, int down,
+	int stop_on_eq)
+{
+	uint32_t i;
+
+	if (down)
+	{
+		for (i = last; i > first; i--)
+			if (elem_eq(a, b, val, (i - 1) * size, size) == stop_on_eq)
+				return n - i;
+		return n;
+	}
+	for (i = first; i < last; i++)
+		if (elem_eq(a, b, val, i * size, size) == stop_on_eq)
+			return i;
+	return n;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static uint32_t scan_sse2(const uint8_t *a, const uint8_t *b, uint16_t val,
+	uint32_t n, int size, int down, int stop_on_eq)
+{
+	uint32_t len = n * size;
+	uint32_t off, chunks = len / 16;
+	__m128i v = size == 1 ? _mm_set1_epi8(val) : _mm_set1_epi16(val);
+	__m128i x, y, c;
+	uint32_t m, i, at;
+
+	for (i = 0; i < chunks; i++)
+	{
+		off = down ? len - 16 * (i + 1) : 16 * i;
+		x = _mm_loadu_si128((const __m128i *)(a + off));
+		y = b ? _mm_loadu_si128((const __m128i *)(b + off)) : v;
+		c = size == 1 ? _mm_cmpeq_epi8(x, y) : _mm_cmpeq_epi16(x, y);
+		m = _mm_movemask_epi8(c);
+		if (!stop_on_eq)
+			m = ~m & 0xFFFF;
+		if (m == 0)
+			continue;
+		if (down)
+		{
+			at = (off + 31 - __builtin_clz(m)) / size;
+			return n - 1 - at;
+		}
+		return (off + __builtin_ctz(m)) / size;
+	}
+
+	if (down)
+		return scan_scalar(a, b, val, n, 0, (len - chunks * 16) / size, size,
+			down, stop_on_eq);
+	return scan_scalar(a, b, val, n, chunks * 16 / size, n, size, down,
+		stop_on_eq);
+}
+
+__attribute__((target("avx2")))
+static uint32_t scan_avx2(const uint8_t *a, const uint8_t *b, uint16_t val,
+	uint32_t n, int size, int down, int stop_on_eq)
+{
+	uint32_t len = n * size;
+	uint32_t off, chunks = len / 32;
+	__m256i v = size == 1 ? _mm256_set1_epi8(val) : _mm256_set1_epi16(val);
+	__m256i x, y, c;
+	uint32_t m, i, at;
+
+	for (i = 0; i < chunks; i++)
+	{
+		off = down ? len - 32 * (i + 1) : 32 * i;
+		x = _mm256_loadu_si256((const __m256i *)(a + off));
+		y = b ? _mm256_loadu_si256((const __m256i *)(b + off)) : v;
+		c = size == 1 ? _mm256_cmpeq_epi8(x, y) : _mm256_cmpeq_epi16(x, y);
+		m = _mm256_movemask_epi8(c);
+		if (!stop_on_eq)
+			m = ~m;
+		if (m == 0)
+			continue;
+		if (down)
+		{
+			at = (off + 31 - __builtin_clz(m)) / size;
+			return n - 1 - at;
+		}
+		return (off + __builtin_ctz(m)) / size;
+	}
+
+	//the rest is under 32 bytes, finish it 16 at a time
+	if (down)
+		return scan_sse2(a, b, val, (len - chunks * 32) / size, size, down,
+			stop_on_eq) + chunks * 32 / size;
+	return scan_sse2(a + chunks * 32, b ? b + chunks * 32 : NULL, val,
+		n - chunks * 32 / size, size, down, stop_on_eq) + chunks * 32 / size;
+}
+#endif
+
+uint32_t str_scan(const uint8_t *a, const uint8_t *b, uint16_t val,
+	uint32_t n, int size, int down, int stop_on_eq)
+{
+#ifdef HAVE_X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return scan_avx2(a, b, val, n, size, down, stop_on_eq);
+	if (__builtin_cpu_supports("sse2"))
+		return scan_sse2(a, b, val, n, size, down, stop_on_eq);
+#endif
+	return scan_scalar(a, b, val, n, 0, n, size, down, stop_on_eq);
+}
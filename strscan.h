@@ -0,0 +1,26 @@
+#ifndef STRSCAN_H
+#define STRSCAN_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+
+/* Search kernels behind REPE/REPNE CMPS and SCAS.  Elements of size 1 or 2
+ * are compared pairwise between a and b, or against val when b is NULL, in
+ * walk order (from the end when down is set).  Returns the walk index of the
+ * first element whose equality matches stop_on_eq, or n if none does. */
+uint32_t str_scan(const uint8_t *a, const uint8_t *b, uint16_t val,
+	uint32_t n, int size, int down, int stop_on_eq);
+
+#endif
@@ -0,0 +1,832 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "intel8086.h"
+#include "video.h"
+#include "mem.h"
+#include "io.h"
+#include "sched.h"
+#include "screenshot.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* MDA and CGA text modes over a 6845 CRTC.  Only the registers that decide
+ * what is on screen are looked at: displayed columns and rows, the start
+ * address and the cursor.  Blinking is shown steady.  Without a character
+ * ROM every printable character is drawn as a block, which still shows the
+ * layout of the screen.
+ *
+ * Drawing works from a Video and a pointer to video RAM, never from the
+ * cpu, so it can run in either of two places.  By default the frame event
+ * draws straight from cpu->ram.  With video_start_thread() the frame event
+ * instead copies video RAM, the registers and the dirty bits into a triple
+ * buffer and a render thread draws from there; the cpu never waits on it,
+ * and if the renderer falls behind it just gets the newest frame. */
+
+static const uint32_t cga_palette[16] = {
+	0x000000, 0x0000AA, 0x00AA00, 0x00AAAA,
+	0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+	0x555555, 0x5555FF, 0x55FF55, 0x55FFFF,
+	0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+#define MDA_NORMAL 0xAAAAAA
+#define MDA_BRIGHT 0xFFFFFF
+
+#define DIRTY_WORDS (VIDEO_CGA_SIZE >> 7)
+
+//the adapter as it stood at one vertical retrace
+typedef struct {
+	Video video;
+	uint64_t number;	//frame count when taken
+	int capture;		//save a numbered screenshot of it
+	uint64_t bits[DIRTY_WORDS];	//words written since the frame before
+	uint8_t vram[VIDEO_CGA_SIZE];
+} Frame;
+
+#define FRAME_FRESH 4
+
+typedef struct Display {
+	//drawing state, belongs to whoever draws and is guarded by lock
+	pthread_mutex_t lock;
+	uint32_t pixels[VIDEO_MAX_W * VIDEO_MAX_H];	//0xRRGGBB
+	int width, height;
+	uint8_t cga_font[256 * 8];
+	uint8_t mda_font[256 * 14];
+	int have_font;
+	Video shown;		//state pixels was drawn with, cursor aside
+	uint16_t cursor;	//cell the cursor was drawn in, 0xFFFF for none
+	int full;		//next render redraws every cell
+	uint64_t cells;		//cells drawn so far
+	//finished pixels for each graphics byte value
+	uint32_t lut[256][8] __attribute__((aligned(16)));
+	//character and attribute of every cell drawn, for screen scraping
+	uint16_t text[VIDEO_MAX_CELLS];
+	int text_cols, text_rows;
+	uint64_t rows_changed;	//since the last video_text()
+	char *shot_name;
+
+	//cpu thread only
+	uint64_t frames;
+	uint32_t shot_every;	//screenshot every so many frames
+	uint64_t bits[DIRTY_WORDS];
+
+	/* Render thread handoff.  The cpu fills slot[write] and swaps it
+	 * into ready, the render thread swaps its slot[read] out of ready;
+	 * slots are only ever written by the cpu thread. */
+	int threaded;
+	pthread_t thread;
+	sem_t wake;
+	pthread_cond_t taken;	//signalled under lock as a frame is taken
+	atomic_int ready;	//slot index, | FRAME_FRESH until taken
+	atomic_int stop;
+	int write, read;
+	Video published;
+	Frame slot[3];
+} Display;
+
+typedef struct {
+	uint32_t size;
+	int cols, rows;
+	int cw, ch;		//cell size in pixels
+	uint16_t start;		//first displayed word
+} TextLayout;
+
+static void text_layout(const Video *v, TextLayout *t)
+{
+	if (v->adapter == VIDEO_MDA)
+	{
+		t->size = VIDEO_MDA_SIZE;
+		t->cw = 9;
+		t->ch = 14;
+	}
+	else
+	{
+		t->size = VIDEO_CGA_SIZE;
+		t->cw = 8;
+		t->ch = 8;
+	}
+	t->cols = v->crtc[1];
+	t->rows = v->crtc[6] & 0x7F;
+	if (t->cols * t->cw > VIDEO_MAX_W)
+		t->cols = VIDEO_MAX_W / t->cw;
+	if (t->rows * t->ch > VIDEO_MAX_H)
+		t->rows = VIDEO_MAX_H / t->ch;
+	t->start = (v->crtc[12] << 8 | v->crtc[13]) & (t->size / 2 - 1);
+}
+
+//9 bits, leftmost pixel in bit 8; the ninth MDA column repeats for line drawing
+static uint16_t glyph_row(Display *d, int mda, uint8_t c, int y)
+{
+	uint8_t row;
+
+	if (!d->have_font)
+		row = c != 0 && c != ' ' && c != 0xFF && y > 0
+			&& y < (mda ? 11 : 7) ? 0x7E : 0;
+	else if (mda)
+		row = d->mda_font[c * 14 + y];
+	else
+		row = d->cga_font[c * 8 + y];
+	if (mda && c >= 0xC0 && c <= 0xDF)
+		return row << 1 | (row & 1);
+	return row << 1;
+}
+
+static void draw_cell(Display *d, const Video *v, const uint8_t *vram,
+	TextLayout *t, int cell, int cursor)
+{
+	int mda = v->adapter == VIDEO_MDA;
+	uint32_t off = (t->start + cell) * 2 & (t->size - 1);
+	uint8_t c = vram[off];
+	uint8_t attr = vram[off + 1];
+	uint32_t fg, bg, *p;
+	uint16_t bits;
+	int x, y, underline = 0;
+
+	if (d->text[cell] != (c | attr << 8))
+	{
+		d->text[cell] = c | attr << 8;
+		d->rows_changed |= 1ULL << (cell / t->cols);
+	}
+
+	if (!mda)
+	{
+		fg = cga_palette[attr & 0x0F];
+		bg = cga_palette[v->mode & VIDEO_MODE_BLINK ? attr >> 4 & 7 : attr >> 4];
+	}
+	else if ((attr & 0x77) == 0)
+		fg = bg = 0;
+	else if ((attr & 0x77) == 0x70)
+	{
+		fg = 0;
+		bg = MDA_NORMAL;
+	}
+	else
+	{
+		fg = attr & 0x08 ? MDA_BRIGHT : MDA_NORMAL;
+		bg = 0;
+		underline = (attr & 0x07) == 1;
+	}
+
+	p = &d->pixels[(cell / t->cols) * t->ch * d->width
+		+ (cell % t->cols) * t->cw];
+	for (y = 0; y < t->ch; y++, p += d->width)
+	{
+		bits = glyph_row(d, mda, c, y);
+		if ((underline && y == 12) || (cursor && y >= (v->crtc[10] & 0x1F)
+			&& y <= (v->crtc[11] & 0x1F)))
+			bits = 0x1FF;
+		for (x = 0; x < t->cw; x++)
+			p[x] = bits & 0x100 >> x ? fg : bg;
+	}
+}
+
+//cell holding the cursor, 0xFFFF when it's hidden or off screen
+static uint16_t cursor_cell(const Video *v, TextLayout *t)
+{
+	uint16_t cell;
+
+	if ((v->crtc[10] & 0x60) == 0x20)
+		return 0xFFFF;
+	cell = ((v->crtc[14] << 8 | v->crtc[15]) - t->start) & (t->size / 2 - 1);
+	return cell < t->cols * t->rows ? cell : 0xFFFF;
+}
+
+/* CGA graphics: 200 lines of 80 bytes, even lines in the first 8K of video
+ * RAM and odd lines in the second.  Each byte is 4 pixels of 2 bits
+ * (320x200) or 8 of 1 bit (640x200); a table built whenever the mode or
+ * colour register changes holds the finished pixels for every byte value,
+ * so converting a byte is one lookup and a 16 or 32 byte copy. */
+static void build_lut(Display *d, const Video *v)
+{
+	static const uint8_t sets[3][3] = { { 2, 4, 6 }, { 3, 5, 7 }, { 3, 4, 7 } };
+	const uint8_t *set;
+	uint32_t colors[4];
+	int b, k;
+
+	if (v->mode & VIDEO_MODE_HIRES)
+	{
+		for (b = 0; b < 256; b++)
+			for (k = 0; k < 8; k++)
+				d->lut[b][k] = b & 0x80 >> k
+					? cga_palette[v->color & 0x0F] : 0;
+		return;
+	}
+	set = sets[v->mode & VIDEO_MODE_BW ? 2 : v->color & 0x20 ? 1 : 0];
+	colors[0] = cga_palette[v->color & 0x0F];
+	for (k = 0; k < 3; k++)
+		colors[k + 1] = cga_palette[set[k] | (v->color & 0x10 ? 8 : 0)];
+	for (b = 0; b < 256; b++)
+		for (k = 0; k < 4; k++)
+			d->lut[b][k] = colors[b >> (6 - 2 * k) & 3];
+}
+
+static void expand(Display *d, const uint8_t *src, uint32_t *dst, int n,
+	int ppb)
+{
+	int i;
+
+#ifdef __SSE2__
+	for (i = 0; i < n; i++, dst += ppb)
+	{
+		_mm_storeu_si128((__m128i *)dst,
+			_mm_load_si128((const __m128i *)d->lut[src[i]]));
+		if (ppb == 8)
+			_mm_storeu_si128((__m128i *)(dst + 4),
+				_mm_load_si128((const __m128i *)&d->lut[src[i]][4]));
+	}
+#else
+	for (i = 0; i < n; i++, dst += ppb)
+		memcpy(dst, d->lut[src[i]], ppb * sizeof(uint32_t));
+#endif
+}
+
+//byte offset in video RAM to the line it's on, -1 past line 199
+static int gfx_line(uint32_t off)
+{
+	int line = (off & 0x1FFF) / 80 * 2 + (off >> 13 & 1);
+
+	return line < 200 ? line : -1;
+}
+
+static int draw_graphics(Display *d, const Video *v, const uint8_t *vram,
+	const uint64_t *dirty)
+{
+	int ppb = v->mode & VIDEO_MODE_HIRES ? 8 : 4;
+	uint32_t w, off;
+	uint64_t bits;
+	int line, drawn = 0;
+
+	if (d->full)
+	{
+		d->full = 0;
+		d->width = 80 * ppb;
+		d->height = 200;
+		d->cursor = 0xFFFF;
+		build_lut(d, v);
+		if (!(v->mode & VIDEO_MODE_ENABLE))
+		{
+			memset(d->pixels, 0, sizeof(d->pixels));
+			return 0;
+		}
+		for (line = 0; line < 200; line++)
+			expand(d, vram + (line & 1) * 0x2000 + line / 2 * 80,
+				&d->pixels[line * d->width], 80, ppb);
+		d->cells += 8000;
+		return 8000;
+	}
+	if (!(v->mode & VIDEO_MODE_ENABLE) || dirty == NULL)
+		return 0;
+	for (w = 0; w < DIRTY_WORDS; w++)
+		for (bits = dirty[w]; bits; bits &= bits - 1)
+		{
+			off = (w * 64 + __builtin_ctzll(bits)) * 2;
+			line = gfx_line(off);
+			if (line < 0)
+				continue;
+			expand(d, vram + off, &d->pixels[line * d->width
+				+ (off & 0x1FFF) % 80 * ppb], 2, ppb);
+			drawn++;
+		}
+	d->cells += drawn;
+	return drawn;
+}
+
+/* Bring the framebuffer up to v and vram, returns the number of cells
+ * (words in graphics modes) drawn.  dirty has a bit per word of video RAM
+ * written since the last call, or is NULL if none was.  A change to
+ * anything but the cursor position redraws the whole screen.  The caller
+ * holds d->lock. */
+static int render(Display *d, const Video *v, const uint8_t *vram,
+	const uint64_t *dirty)
+{
+	Video now;
+	TextLayout t;
+	uint16_t cursor;
+	uint32_t w, i, cell, ncells;
+	uint64_t bits;
+	int drawn = 0;
+
+	now = *v;
+	now.index = 0;
+	now.crtc[14] = now.crtc[15] = 0;
+	if (memcmp(&now, &d->shown, sizeof(Video)) != 0)
+	{
+		d->shown = now;
+		d->full = 1;
+	}
+	if (v->adapter == VIDEO_CGA && (v->mode & VIDEO_MODE_GRAPHICS))
+		return draw_graphics(d, v, vram, dirty);
+
+	text_layout(v, &t);
+	ncells = t.cols * t.rows;
+	if (!(v->mode & VIDEO_MODE_ENABLE))
+		ncells = 0;
+	cursor = ncells ? cursor_cell(v, &t) : 0xFFFF;
+
+	if (d->full)
+	{
+		d->full = 0;
+		d->width = t.cols * t.cw;
+		d->height = t.rows * t.ch;
+		if (ncells == 0)
+			memset(d->pixels, 0, sizeof(d->pixels));
+		if (ncells == 0 || d->text_cols != t.cols || d->text_rows != t.rows)
+		{
+			memset(d->text, 0, sizeof(d->text));
+			d->text_cols = ncells ? t.cols : 0;
+			d->text_rows = ncells ? t.rows : 0;
+			d->rows_changed = ~0ULL;
+		}
+		for (cell = 0; cell < ncells; cell++)
+			draw_cell(d, v, vram, &t, cell, cell == cursor);
+		d->cursor = cursor;
+		d->cells += ncells;
+		return ncells;
+	}
+
+	if (ncells && dirty)
+	{
+		for (w = 0; w < t.size >> 7; w++)
+			for (bits = dirty[w]; bits; bits &= bits - 1)
+			{
+				i = w * 64 + __builtin_ctzll(bits);
+				cell = (i - t.start) & (t.size / 2 - 1);
+				if (cell >= ncells)
+					continue;
+				draw_cell(d, v, vram, &t, cell, cell == cursor);
+				drawn++;
+			}
+	}
+	if (cursor != d->cursor)
+	{
+		if (d->cursor < ncells)
+			draw_cell(d, v, vram, &t, d->cursor, 0);
+		if (cursor < ncells)
+			draw_cell(d, v, vram, &t, cursor, 1);
+		d->cursor = cursor;
+		drawn += 2;
+	}
+	d->cells += drawn;
+	return drawn;
+}
+
+static uint32_t vram_base(X86Cpu *cpu)
+{
+	return cpu->video.adapter == VIDEO_MDA ? VIDEO_MDA_BASE : VIDEO_CGA_BASE;
+}
+
+static uint32_t vram_size(X86Cpu *cpu)
+{
+	return cpu->video.adapter == VIDEO_MDA ? VIDEO_MDA_SIZE : VIDEO_CGA_SIZE;
+}
+
+/* Draw in the cpu thread, straight from cpu->ram.  With the render thread
+ * running this does nothing; the framebuffer is as of the last frame it
+ * drew. */
+int video_render(X86Cpu *cpu)
+{
+	Display *d = cpu->display;
+	int dirty, n;
+
+	if (d->threaded)
+		return 0;
+	dirty = mem_take_dirty(cpu, vram_base(cpu), vram_size(cpu), d->bits);
+	pthread_mutex_lock(&d->lock);
+	n = render(d, &cpu->video, &cpu->ram[vram_base(cpu)],
+		dirty ? d->bits : NULL);
+	pthread_mutex_unlock(&d->lock);
+	return n;
+}
+
+static uint32_t frame_cycles(X86Cpu *cpu)
+{
+	return cpu->video.adapter == VIDEO_MDA ? VIDEO_MDA_FRAME : VIDEO_CGA_FRAME;
+}
+
+//shot.png becomes shot-000120.png for frame 120, d->lock held
+static void capture_frame(Display *d, uint64_t number)
+{
+	const char *ext;
+	char name[4096];
+	int stem;
+
+	if (d->shot_name == NULL)
+		return;
+	ext = strrchr(d->shot_name, '.');
+	if (ext == NULL || strchr(ext, '/'))
+		ext = d->shot_name + strlen(d->shot_name);
+	stem = ext - d->shot_name;
+	snprintf(name, sizeof(name), "%.*s-%06llu%s", stem, d->shot_name,
+		(unsigned long long)number, ext);
+	if (screenshot_save(name, d->pixels, d->width, d->height) != 0)
+		fprintf(stderr, "couldn't write screenshot %s\n", name);
+}
+
+/* Hand the frame to the render thread, unless nothing about it changed.
+ * Bits of a frame still waiting in ready are folded into the new one, so
+ * a frame the renderer never saw loses nothing.  A waiting frame that is
+ * to be captured is never folded away, the cpu waits for it to be taken. */
+static void publish(X86Cpu *cpu, int capture)
+{
+	Display *d = cpu->display;
+	Frame *f = &d->slot[d->write];
+	Video now = cpu->video;
+	int w, old;
+
+	now.index = 0;
+	if (d->slot[atomic_load(&d->ready) & 3].capture)
+	{
+		pthread_mutex_lock(&d->lock);
+		while ((old = atomic_load(&d->ready)) & FRAME_FRESH
+			&& d->slot[old & 3].capture)
+			pthread_cond_wait(&d->taken, &d->lock);
+		pthread_mutex_unlock(&d->lock);
+	}
+	if (!mem_take_dirty(cpu, vram_base(cpu), vram_size(cpu), f->bits))
+	{
+		if (!capture && memcmp(&now, &d->published, sizeof(Video)) == 0)
+			return;
+		memset(f->bits, 0, sizeof(f->bits));
+	}
+	old = atomic_load(&d->ready);
+	if (old & FRAME_FRESH)
+		for (w = 0; w < DIRTY_WORDS; w++)
+			f->bits[w] |= d->slot[old & 3].bits[w];
+	f->video = now;
+	f->number = d->frames;
+	f->capture = capture;
+	memcpy(f->vram, &cpu->ram[vram_base(cpu)], vram_size(cpu));
+	d->published = now;
+
+	old = atomic_exchange(&d->ready, d->write | FRAME_FRESH);
+	d->write = old & 3;
+	sem_post(&d->wake);
+}
+
+static void *render_main(void *arg)
+{
+	Display *d = arg;
+	Frame *f;
+
+	//a frame published before the stop is still drawn
+	for (;;)
+	{
+		sem_wait(&d->wake);
+		if (atomic_load(&d->ready) & FRAME_FRESH)
+		{
+			pthread_mutex_lock(&d->lock);
+			d->read = atomic_exchange(&d->ready, d->read) & 3;
+			pthread_cond_broadcast(&d->taken);
+			f = &d->slot[d->read];
+			render(d, &f->video, f->vram, f->bits);
+			if (f->capture)
+				capture_frame(d, f->number);
+			pthread_mutex_unlock(&d->lock);
+		}
+		if (atomic_load(&d->stop))
+			break;
+	}
+	return NULL;
+}
+
+static void video_frame(X86Cpu *cpu)
+{
+	Display *d = cpu->display;
+	uint64_t frame = frame_cycles(cpu);
+	int capture;
+
+	d->frames++;
+	capture = d->shot_every && d->frames % d->shot_every == 0;
+	if (d->threaded)
+		publish(cpu, capture);
+	else
+	{
+		video_render(cpu);
+		if (capture)
+		{
+			pthread_mutex_lock(&d->lock);
+			capture_frame(d, d->frames);
+			pthread_mutex_unlock(&d->lock);
+		}
+	}
+	sched_at(cpu, SCHED_VIDEO, (cpu->cycles / frame + 1) * frame);
+}
+
+int video_start_thread(X86Cpu *cpu)
+{
+	Display *d = cpu->display;
+
+	if (d->threaded)
+		return 0;
+	if (sem_init(&d->wake, 0, 0) != 0)
+		return -1;
+	d->write = 0;
+	d->read = 1;
+	atomic_store(&d->ready, 2);
+	atomic_store(&d->stop, 0);
+	//make the first frame go out whatever it holds
+	memset(&d->published, 0xFF, sizeof(Video));
+	pthread_mutex_lock(&d->lock);
+	d->full = 1;
+	pthread_mutex_unlock(&d->lock);
+	if (pthread_create(&d->thread, NULL, render_main, d) != 0)
+	{
+		sem_destroy(&d->wake);
+		return -1;
+	}
+	d->threaded = 1;
+	return 0;
+}
+
+void video_stop_thread(X86Cpu *cpu)
+{
+	Display *d = cpu->display;
+
+	if (!d->threaded)
+		return;
+	atomic_store(&d->stop, 1);
+	sem_post(&d->wake);
+	pthread_join(d->thread, NULL);
+	sem_destroy(&d->wake);
+	d->threaded = 0;
+	//what cpu->ram holds now may be ahead of the last frame drawn
+	pthread_mutex_lock(&d->lock);
+	d->full = 1;
+	pthread_mutex_unlock(&d->lock);
+}
+
+//the screen as it is now, PPM or PNG by the file name
+int video_screenshot(X86Cpu *cpu, const char *filename)
+{
+	Display *d = cpu->display;
+	int ret;
+
+	video_render(cpu);
+	pthread_mutex_lock(&d->lock);
+	ret = screenshot_save(filename, d->pixels, d->width, d->height);
+	pthread_mutex_unlock(&d->lock);
+	return ret;
+}
+
+/* Save a numbered screenshot every so many frames, 0 stops.  The name is
+ * copied; the frame number goes in front of its extension.  The render
+ * thread may skip frames but never one that is to be saved. */
+int video_capture(X86Cpu *cpu, const char *filename, uint32_t every)
+{
+	Display *d = cpu->display;
+	char *name = NULL;
+
+	if (every && (name = strdup(filename)) == NULL)
+		return -1;
+	pthread_mutex_lock(&d->lock);
+	free(d->shot_name);
+	d->shot_name = name;
+	pthread_mutex_unlock(&d->lock);
+	d->shot_every = every;
+	return 0;
+}
+
+//the beam position follows from the cycle count
+static uint8_t video_status(X86Cpu *cpu)
+{
+	uint64_t pos = cpu->cycles % frame_cycles(cpu);
+	uint32_t line, x;
+	uint8_t val = 0xF0;
+
+	if (cpu->video.adapter == VIDEO_MDA)
+	{
+		line = pos / VIDEO_MDA_LINE;
+		x = pos % VIDEO_MDA_LINE;
+		if (x >= 225)
+			val |= 0x01;
+		if (line < 350 && x < 225)
+			val |= 0x08;
+		return val;
+	}
+	line = pos / VIDEO_CGA_LINE;
+	x = pos % VIDEO_CGA_LINE;
+	if (line >= 200 || x >= 213)
+		val |= 0x01;
+	if (line >= 224 && line < 240)
+		val |= 0x08;
+	return val;
+}
+
+uint8_t video_read(X86Cpu *cpu, uint16_t port)
+{
+	Video *v = &cpu->video;
+
+	port &= 0x0F;
+	if (port < 8)
+	{
+		//only the cursor and light pen registers read back
+		if ((port & 1) && v->index >= 14 && v->index < 18)
+			return v->crtc[v->index];
+		return 0xFF;
+	}
+	if (port == 0x0A)
+		return video_status(cpu);
+	return 0xFF;
+}
+
+void video_write(X86Cpu *cpu, uint16_t port, uint8_t val)
+{
+	Video *v = &cpu->video;
+
+	port &= 0x0F;
+	if (port < 8)
+	{
+		if (!(port & 1))
+			v->index = val & 0x1F;
+		else if (v->index < 16)
+			v->crtc[v->index] = val;
+		return;
+	}
+	switch (port)
+	{
+		case 0x08:
+			v->mode = val;
+			break;
+		case 0x09:
+			if (v->adapter == VIDEO_CGA)
+				v->color = val;
+			break;
+	}
+}
+
+/* A 2K file is a plain 8x8 font, an 8K one the 5150's character ROM with
+ * the MDA glyphs split over its first two 2K banks and the CGA font last. */
+int video_load_font(X86Cpu *cpu, const char *filename)
+{
+	Display *d = cpu->display;
+	uint8_t *rom;
+	size_t len;
+	FILE *fp;
+	int c, y;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "character ROM %s not found!\n", filename);
+		return -1;
+	}
+	rom = malloc(0x2001);
+	if (rom == NULL)
+	{
+		fclose(fp);
+		return -1;
+	}
+	len = fread(rom, 1, 0x2001, fp);
+	fclose(fp);
+	if (len != 0x800 && len != 0x2000)
+	{
+		fprintf(stderr, "%s is not a 2K or 8K character ROM\n", filename);
+		free(rom);
+		return -1;
+	}
+
+	pthread_mutex_lock(&d->lock);
+	memset(d->mda_font, 0, sizeof(d->mda_font));
+	for (c = 0; c < 256; c++)
+		for (y = 0; y < 14; y++)
+		{
+			if (len == 0x800 && y < 8)
+				d->mda_font[c * 14 + y] = rom[c * 8 + y];
+			else if (len == 0x2000)
+				d->mda_font[c * 14 + y] = rom[(y < 8 ? 0 : 0x800)
+					+ c * 8 + (y & 7)];
+		}
+	memcpy(d->cga_font, len == 0x800 ? rom : rom + 0x1800, 0x800);
+	free(rom);
+	d->have_font = 1;
+	d->full = 1;
+	pthread_mutex_unlock(&d->lock);
+	return 0;
+}
+
+//the framebuffer itself, only safe to read without the render thread
+const uint32_t *video_pixels(X86Cpu *cpu, int *width, int *height)
+{
+	*width = cpu->display->width;
+	*height = cpu->display->height;
+	return cpu->display->pixels;
+}
+
+//a consistent copy of the framebuffer, size in pixels
+int video_copy_pixels(X86Cpu *cpu, uint32_t *dst, size_t size, int *width,
+	int *height)
+{
+	Display *d = cpu->display;
+	int ret = -1;
+
+	video_render(cpu);
+	pthread_mutex_lock(&d->lock);
+	if ((size_t)d->width * d->height <= size)
+	{
+		memcpy(dst, d->pixels, sizeof(uint32_t) * d->width * d->height);
+		*width = d->width;
+		*height = d->height;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return ret;
+}
+
+//code page 437 as close as plain ASCII gets
+static char text_char(uint8_t c)
+{
+	if (c >= 0x20 && c < 0x7F)
+		return c;
+	if (c == 0xB3 || c == 0xBA)
+		return '|';
+	if (c == 0xC4 || c == 0xCD)
+		return '-';
+	if (c >= 0xB4 && c <= 0xDA)
+		return '+';
+	if (c == 0 || c == 0xFF)
+		return ' ';
+	return '.';
+}
+
+/* The text screen as NUL terminated lines, one per row.  changed, if not
+ * NULL, gets a bit per row whose characters or attributes changed since
+ * the previous call.  Both come from the cells the renderer redrew, so a
+ * poll of an unchanged screen reads no video RAM at all.  Returns the
+ * number of rows, 0 in a graphics mode, or -1 if buf is too small. */
+int video_text(X86Cpu *cpu, char *buf, size_t size, uint64_t *changed)
+{
+	Display *d = cpu->display;
+	int row, col, n = 0;
+
+	video_render(cpu);
+	pthread_mutex_lock(&d->lock);
+	if (d->shown.adapter == VIDEO_CGA
+		&& (d->shown.mode & VIDEO_MODE_GRAPHICS))
+	{
+		d->text_cols = d->text_rows = 0;
+		d->rows_changed = 0;
+	}
+	if ((size_t)(d->text_cols + 1) * d->text_rows + 1 > size)
+	{
+		pthread_mutex_unlock(&d->lock);
+		return -1;
+	}
+	for (row = 0; row < d->text_rows; row++)
+	{
+		for (col = 0; col < d->text_cols; col++)
+			buf[n++] = text_char(d->text[row * d->text_cols + col] & 0xFF);
+		buf[n++] = '\n';
+	}
+	buf[n] = '\0';
+	if (changed)
+		*changed = d->rows_changed & (d->text_rows < 64
+			? (1ULL << d->text_rows) - 1 : ~0ULL);
+	d->rows_changed = 0;
+	row = d->text_rows;
+	pthread_mutex_unlock(&d->lock);
+	return row;
+}
+
+static const IoHandler video_ports = { video_read, video_write, NULL, NULL };
+
+int video_init(X86Cpu *cpu)
+{
+	Video *v = &cpu->video;
+	int mda;
+
+	cpu->display = calloc(1, sizeof(Display));
+	if (cpu->display == NULL)
+		return -1;
+	pthread_mutex_init(&cpu->display->lock, NULL);
+	pthread_cond_init(&cpu->display->taken, NULL);
+	cpu->display->cursor = 0xFFFF;
+	cpu->display->full = 1;
+
+	memset(v, 0, sizeof(Video));
+	mda = (cpu->ppi.sw1 & 0x30) == 0x30;
+	v->adapter = mda ? VIDEO_MDA : VIDEO_CGA;
+	mem_map(cpu, mda ? VIDEO_MDA_BASE : VIDEO_CGA_BASE,
+		mda ? VIDEO_MDA_SIZE : VIDEO_CGA_SIZE, MEM_WATCH, NULL);
+	io_register(cpu, mda ? VIDEO_MDA_PORT : VIDEO_CGA_PORT, 16, &video_ports);
+	sched_register(cpu, SCHED_VIDEO, video_frame);
+	sched_at(cpu, SCHED_VIDEO, frame_cycles(cpu));
+	return 0;
+}
+
+void video_free(X86Cpu *cpu)
+{
+	if (cpu->display)
+	{
+		video_stop_thread(cpu);
+		pthread_cond_destroy(&cpu->display->taken);
+		pthread_mutex_destroy(&cpu->display->lock);
+		free(cpu->display->shot_name);
+	}
+	free(cpu->display);
+	cpu->display = NULL;
+}
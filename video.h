@@ -0,0 +1,82 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+/* This file is part of Project Acorn.  Project Acorn is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+struct X86Cpu;
+
+/* One display adapter, MDA or CGA as SW1 says.  Video RAM is watched RAM
+ * (see mem.h), so the guest writes it at full speed and once a frame only
+ * the text cells whose words were written are drawn again into the host
+ * framebuffer.  A frame in which nothing was written draws nothing.
+ * Drawing can be moved off the cpu thread with video_start_thread(). */
+enum { VIDEO_CGA, VIDEO_MDA };
+
+#define VIDEO_CGA_BASE 0xB8000
+#define VIDEO_CGA_SIZE 0x4000
+#define VIDEO_CGA_PORT 0x3D0
+#define VIDEO_MDA_BASE 0xB0000
+#define VIDEO_MDA_SIZE 0x1000
+#define VIDEO_MDA_PORT 0x3B0
+
+//cpu cycles per scanline and per frame, CGA 262 lines at 59.9Hz, MDA 370 at 49.8Hz
+#define VIDEO_CGA_LINE 304
+#define VIDEO_CGA_FRAME (262 * VIDEO_CGA_LINE)
+#define VIDEO_MDA_LINE 259
+#define VIDEO_MDA_FRAME (370 * VIDEO_MDA_LINE)
+
+//large enough for MDA's 80x25 9x14 cells
+#define VIDEO_MAX_W 720
+#define VIDEO_MAX_H 350
+#define VIDEO_MAX_CELLS ((VIDEO_MAX_W / 8) * (VIDEO_MAX_H / 8))
+
+//mode control register
+#define VIDEO_MODE_80COL	0x01
+#define VIDEO_MODE_GRAPHICS	0x02
+#define VIDEO_MODE_BW		0x04
+#define VIDEO_MODE_ENABLE	0x08
+#define VIDEO_MODE_HIRES	0x10	//640x200 graphics
+#define VIDEO_MODE_BLINK	0x20
+
+//guest visible state, part of X86Cpu
+typedef struct {
+	uint8_t adapter;
+	uint8_t index;		//6845 register selected
+	uint8_t crtc[18];
+	uint8_t mode;
+	uint8_t color;		//CGA colour select
+} Video;
+
+//host side framebuffer and render thread, private to video.c
+struct Display;
+
+int video_init(struct X86Cpu *cpu);
+void video_free(struct X86Cpu *cpu);
+int video_load_font(struct X86Cpu *cpu, const char *filename);
+uint8_t video_read(struct X86Cpu *cpu, uint16_t port);
+void video_write(struct X86Cpu *cpu, uint16_t port, uint8_t val);
+int video_render(struct X86Cpu *cpu);
+const uint32_t *video_pixels(struct X86Cpu *cpu, int *width, int *height);
+int video_text(struct X86Cpu *cpu, char *buf, size_t size, uint64_t *changed);
+int video_screenshot(struct X86Cpu *cpu, const char *filename);
+int video_capture(struct X86Cpu *cpu, const char *filename, uint32_t every);
+int video_copy_pixels(struct X86Cpu *cpu, uint32_t *dst, size_t size,
+	int *width, int *height);
+int video_start_thread(struct X86Cpu *cpu);
+void video_stop_thread(struct X86Cpu *cpu);
+
+#endif